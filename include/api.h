@@ -1,6 +1,8 @@
 #ifndef API_H
 #define API_H
 
+#include <stddef.h>
+
 typedef struct {
   int width;
   int height;
@@ -11,13 +13,69 @@ typedef struct {
   char* data;
 } Board;
 
-int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path);
+/// One connection to the server. Handles are independent: any number of them
+/// can be used at once, each from its own threads. Within a handle, one thread
+/// receives while others play, predict or disconnect.
+typedef struct pacman_client pacman_client_t;
+
+/// Creates both FIFOs, registers with the server and waits for the ack.
+/// @return the new handle, or NULL on failure.
+pacman_client_t *pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path);
+
+/// Sends a command to the server. W/A/S/D moves are also predicted locally
+/// until a state frame confirms them. @return 0 on success, -1 otherwise.
+int pacman_play(pacman_client_t *client, char command);
+
+/// Sends n scripted commands in one OP_CODE_PLAY_BATCH (n <= MAX_BATCH_PLAYS).
+/// Command i runs after the pacman idles waits[i] ticks (waits may be NULL for
+/// none). Keep pacman_unacked() + n <= SCRIPT_QUEUE_SIZE: an overflowing batch
+/// ends the session. @return 0 on success, -1 otherwise.
+int pacman_play_batch(pacman_client_t *client, const char *commands, const unsigned short *waits, int n);
+
+/// Plays sent that no state frame has acknowledged yet.
+int pacman_unacked(pacman_client_t *client);
+
+/// Writes the last state frame, with every unconfirmed move replayed on our
+/// pacman, into cells (cap bytes) and points board->data at it.
+/// @return 1 on success, 0 before the first state frame of a level, -1 if the
+/// frame needs more than cap bytes (board holds its size).
+int pacman_predict(pacman_client_t *client, Board *board, char *cells, size_t cap);
+
+/// Asks the server for frames of at most width x height cells around pacman
+/// (0 x 0 for the whole board). @return 0 on success, -1 otherwise.
+int pacman_set_viewport(pacman_client_t *client, int width, int height);
+
+/// Leaves the game and removes the FIFOs. The server then closes the session,
+/// which ends a receive_board_update blocked on another thread. The handle
+/// stays valid until pacman_close. @return 0 on success, 1 otherwise.
+int pacman_disconnect(pacman_client_t *client);
+
+/// Releases the handle (disconnecting first if needed). No other thread may
+/// be using it.
+void pacman_close(pacman_client_t *client);
+
+/// Blocks until the next board frame and writes it into cells (cap bytes),
+/// with board->data pointing at it. @return 1 on a frame, 0 once the server
+/// closed the session, -1 if the frame needs more than cap bytes: board holds
+/// its size and the frame is kept for the next call.
+int receive_board_update(pacman_client_t *client, Board *board, char *cells, size_t cap);
+
+/// Non-blocking use, for event loops that drive many handles from one
+/// thread: poll pacman_notif_fd for input, then call pacman_pump (or read
+/// the fd yourself and hand the bytes to pacman_feed). The newest frame is
+/// then read with pacman_predict. Do not mix with receive_board_update.
 
-int pacman_play(char command);
+/// The notification fd of the handle, -1 once closed.
+int pacman_notif_fd(pacman_client_t *client);
 
-/// @return 0 if the disconnection was successful, 1 otherwise.
-int pacman_disconnect();
+/// Decodes n more bytes of the notification stream. Partial frames are kept
+/// until the rest arrives. @return the state frames completed (0 if none),
+/// or -1 on a malformed stream.
+int pacman_feed(pacman_client_t *client, const void *bytes, size_t n);
 
-Board receive_board_update(void);
+/// One read of the notification fd, decoded as in pacman_feed. Only blocks if
+/// the fd has nothing to read. @return the state frames completed (0 if none
+/// yet), or -1 once the server closed the session.
+int pacman_pump(pacman_client_t *client);
 
-#endif
\ No newline at end of file
+#endif
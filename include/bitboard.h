@@ -0,0 +1,49 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+
+/*
+Bit planes: one bit per cell, kept row-major (64 cells of a row per word)
+and transposed (64 cells of a column per word), so counting cells and
+finding the first set cell along a row or column are popcount/ctz/clz
+over whole words instead of per-cell scans.
+*/
+
+typedef struct {
+    int width, height;
+    int row_words;      // words per row
+    int col_words;      // words per column
+    uint64_t *rows;     // height * row_words
+    uint64_t *cols;     // width * col_words, transposed copy
+} bitplane_t;
+
+/*Allocates an empty plane. Returns -1 on allocation failure*/
+int plane_init(bitplane_t* plane, int width, int height);
+
+void plane_free(bitplane_t* plane);
+
+static inline void plane_set(bitplane_t* plane, int x, int y) {
+    plane->rows[y * plane->row_words + (x >> 6)] |= 1ULL << (x & 63);
+    plane->cols[x * plane->col_words + (y >> 6)] |= 1ULL << (y & 63);
+}
+
+static inline void plane_clear(bitplane_t* plane, int x, int y) {
+    plane->rows[y * plane->row_words + (x >> 6)] &= ~(1ULL << (x & 63));
+    plane->cols[x * plane->col_words + (y >> 6)] &= ~(1ULL << (y & 63));
+}
+
+static inline int plane_test(const bitplane_t* plane, int x, int y) {
+    return (int)((plane->rows[y * plane->row_words + (x >> 6)] >> (x & 63)) & 1);
+}
+
+/*Number of set cells*/
+int plane_count(const bitplane_t* plane);
+
+/*First set cell of row y strictly after x in direction dx (+1 or -1), at most span cells away: its x, or -1*/
+int plane_scan_row(const bitplane_t* plane, int y, int x, int dx, int span);
+
+/*First set cell of column x strictly after y in direction dy (+1 or -1), at most span cells away: its y, or -1*/
+int plane_scan_col(const bitplane_t* plane, int x, int y, int dy, int span);
+
+#endif
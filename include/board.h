@@ -7,10 +7,19 @@
 #define MAX_GHOSTS 25
 
 #define MAX_PENDING_CLIENTS 100  // tamanho máximo da fila
+#define SESSION_INPUT_SIZE 2048 // request bytes buffered per session: a whole OP_CODE_PLAY_BATCH fits
+#define OUT_BUF_KEEP (1 << 20) // bigger output buffers (a huge level frame) are freed once drained
+#define CONNECT_TIMEOUT_MS 5000 // a client has this long to open its FIFOs after OP_CODE_CONNECT
+#define CONNECT_RETRY_MS 10
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <stdatomic.h>
 #include "protocol.h"
+#include "wheel.h"
+#include "bitboard.h"
 
 typedef enum {
     REACHED_PORTAL = 1,
@@ -34,6 +43,8 @@ typedef struct {
     int current_move;
     int n_moves;
     int waiting;
+    wheel_timer_t timer; // next time the pacman takes input
+    atomic_int due;
 } pacman_t;
 
 typedef struct {
@@ -44,18 +55,62 @@ typedef struct {
     int current_move;
     int waiting;
     int charged;
+    wheel_timer_t timer; // next time the ghost moves
+    atomic_int due;
 } ghost_t;
 
-typedef struct {
-    char content; // stuff like 'P' for pacman 'M' for monster and 'W' for wall
-    int has_dot; // whether there is a dot in this position or not
-    int has_portal; // whether there is a portal in this position or not
-    pthread_mutex_t lock;
-} board_pos_t;
+// One byte per cell: what occupies it plus what lies on the floor
+typedef unsigned char cell_t;
+
+#define CELL_WALL   0x01
+#define CELL_PACMAN 0x02
+#define CELL_GHOST  0x04
+#define CELL_DOT    0x08
+#define CELL_PORTAL 0x10
+#define CELL_START_DOT 0x20 // a dot was here when the level started
+#define CELL_CONTENT (CELL_WALL | CELL_PACMAN | CELL_GHOST) // at most one of these is set
+
+// Bit planes mirroring the cell flags, for whole-row/column queries
+enum {
+    PLANE_WALL = 0,
+    PLANE_DOT,
+    PLANE_PORTAL,
+    PLANE_PACMAN,
+    PLANE_GHOST,
+    N_PLANES
+};
+
+// Cells are stored in TILE_SIZE x TILE_SIZE tiles so huge, mostly solid maps stay small
+#define TILE_SHIFT 6
+#define TILE_SIZE (1 << TILE_SHIFT)
+#define TILE_MASK (TILE_SIZE - 1)
+#define TILE_CELLS (TILE_SIZE * TILE_SIZE)
+
+#define MAX_BOARD_SIDE 65535 // coordinates travel as 16 bit values
+#define WALL_DIST_MAX_CELLS (1 << 22) // bigger boards skip the wall jump table
+
+enum {
+    DIR_UP = 0,
+    DIR_DOWN,
+    DIR_LEFT,
+    DIR_RIGHT,
+    N_DIRS
+};
 
 typedef struct {
     int width, height; //dimensions of the board
-    board_pos_t* board; //actual board, most likely a row-major matrix
+    int tiles_w, tiles_h; // tile grid over the (width + 2) x (height + 2) bordered cells
+    cell_t** tiles; // row-major tiles; the all-wall ones share solid_tile
+    cell_t* solid_tile; // read-only tile of walls, also the sentinel border
+    bitplane_t planes[N_PLANES]; // same cells as bits, built by load_level
+    uint16_t* wall_dist[N_DIRS]; // per cell and direction: steps to the nearest wall or edge, NULL on huge boards
+    int* occ_head; // per hash bucket of (x, y): first entity id there, ENTITY_NONE if empty
+    int* occ_next; // per entity id: next entity in the same bucket
+    unsigned occ_mask; // buckets - 1
+    int n_dots; // dots at level start
+    uint64_t* start_dots; // cells that held a dot at level start, as rows of the plane words
+    int* row_dots; // per row: starting dots in the rows above it (height + 1 entries)
+    unsigned char* eaten; // one bit per starting dot, numbered row-major: set once eaten
     int n_pacmans; //number of pacmans in the board
     pacman_t* pacmans; // array containing every pacman in the board to iterate through when processing
     int n_ghosts; //number of ghosts in the board
@@ -65,10 +120,74 @@ typedef struct {
     char ghosts_files[MAX_GHOSTS][256]; // files with monster movements
     int tempo; // Duracao de cada jogada???
     char dirname[MAX_FILENAME]; // Directory where level files are stored
-    pthread_rwlock_t state_lock;
+    unsigned long version; // bumped on every cell change
 } board_t;
 
+// Cell (x, y) of the board; x = -1 .. width and y = -1 .. height are the sentinel border.
+// Solid tiles are shared: only write through board_cell_mut unless the cell holds no wall
+static inline cell_t* board_cell(board_t* board, int x, int y) {
+    int bx = x + 1, by = y + 1;
+    cell_t* tile = board->tiles[(by >> TILE_SHIFT) * board->tiles_w + (bx >> TILE_SHIFT)];
+    return &tile[((by & TILE_MASK) << TILE_SHIFT) | (bx & TILE_MASK)];
+}
+
+// Replaces the occupant of a cell, keeping its dot/portal
+static inline void cell_set_content(cell_t* cell, cell_t content) {
+    *cell = (cell_t)((*cell & ~CELL_CONTENT) | content);
+}
+
+// Occupancy index ids: pacman i is i, ghost i is n_pacmans + i
+#define ENTITY_NONE -1
+
+static inline int board_ghost_id(board_t* board, int ghost_index) {
+    return board->n_pacmans + ghost_index;
+}
+
+// Character of the static layer: what never moves, with the dots the level started with
+static inline char cell_static(cell_t cell) {
+    if (cell & CELL_WALL) return '#';
+    if (cell & CELL_PORTAL) return '@';
+    if (cell & CELL_START_DOT) return '.';
+    return ' ';
+}
+
+// Character the client draws for a cell
+static inline char cell_display(cell_t cell) {
+    if (cell & CELL_WALL) return '#';
+    if (cell & CELL_PACMAN) return 'C';
+    if (cell & CELL_GHOST) return 'M';
+    if (cell & CELL_PORTAL) return '@';
+    if (cell & CELL_DOT) return '.';
+    return ' ';
+}
+
+enum {
+    IO_WAKE = 0,    // worker eventfd: sessions waiting in the inbox
+    IO_REQUEST = 1, // session req_fd readable
+    IO_NOTIF = 2,   // session notif_fd writable again
+    IO_TIMER = 3,   // worker timing wheel timer expired
+};
+
+// epoll user data: which fd of which session is ready
+typedef struct {
+    int kind;
+    struct session *sess;
+} io_event_t;
+
+// What readers outside the session step (leaderboard, monitoring) may see.
+// Only long words, so the seqlock copies it word by word.
 typedef struct {
+    long client_id;
+    long active;        // attached to a client that did not disconnect
+    long points;
+    long victory;
+    long game_over;
+    long version;       // board version of this snapshot
+    long ticks;
+    long overruns;
+} session_snapshot_t;
+
+typedef struct session {
     int client_id;
     int req_fd;     // servidor lê OP_PLAY/OP_DISCONNECT
     int notif_fd;   // servidor escreve OP_BOARD
@@ -83,12 +202,66 @@ typedef struct {
     char last_cmd;
     int has_cmd;
 
-    int shutdown;     // global stop flag for session threads
+    pthread_mutex_t exec_lock; // held by whichever worker runs or serves this session
+    struct worker *worker;   // event loop that owns this session
+    struct session *next;    // link in a worker inbox or in the free slot list
+    int closing;             // game finished, flushing the last frames
+    io_event_t req_ev, notif_ev;
+
+    timing_wheel_t *wheel;   // timing wheel of the owning worker
+    wheel_timer_t frame_timer;
+    atomic_int frame_due;
+    atomic_int ready;        // queued in some worker run queue
+    struct session *ready_next;
+    int release_pending;     // detached while queued: the run queue entry frees the slot
+    int steals;              // consecutive steps run by another worker
+
+    // tick clock accounting for the current game
+    unsigned long ticks;     // timer expirations handled
+    unsigned long late_ticks; // handled after their deadline
+    unsigned long overruns;  // deadlines dropped by the catch-up policy
+    unsigned long long total_lateness_ms;
+    unsigned long long max_lateness_ms;
+
+    unsigned char in_buf[SESSION_INPUT_SIZE]; // request bytes read, at most one partial request after a drain
+    int in_len;
+    int req_eof;
+    // input mailbox, filled as requests are drained and emptied by the pacman step.
+    // Both run under exec_lock, so it needs no lock of its own
+    char play_cmd[INPUT_QUEUE_MAX]; // plays not applied yet, oldest first
+    uint32_t play_seq[INPUT_QUEUE_MAX];
+    int n_plays;
+    int quit_req;            // 'Q' or OP_CODE_DISCONNECT arrived: end at the next step
+    // plays of OP_CODE_PLAY_BATCH, a ring run ahead of the mailbox
+    char script_cmd[SCRIPT_QUEUE_SIZE];
+    uint16_t script_wait[SCRIPT_QUEUE_SIZE]; // pacman ticks left to idle before the play
+    uint32_t script_seq[SCRIPT_QUEUE_SIZE];
+    int script_head, script_len;
+
+    unsigned codecs;         // CODEC_BIT mask the client decodes
+    unsigned long frame_version; // board version of the last frame sent
+    int need_level;          // new level or client asked for OP_CODE_RESYNC
+    int need_state;          // send a state frame even if the board did not change
+    int view_w, view_h;      // viewport asked with OP_CODE_VIEWPORT, 0 for the whole board
+    int view_x, view_y;      // window origin of the last state frame
+    uint32_t play_ack;       // highest play seq applied, echoed in state frames
+
+    char *out_buf;           // frames not yet written to notif_fd
+    size_t out_len, out_off, out_cap;
+    int out_watched;         // EPOLLOUT armed on notif_fd
+
+    atomic_uint snap_seq;    // seqlock: odd while snap is being written
+    session_snapshot_t snap; // published by engine_publish
+
+    DIR *level_dir;          // levels still to play
+    int accumulated_points;
+    int pending_unload;
 } session_t;
 
 typedef struct {
     char req_pipe_path[MAX_PIPE_PATH_LENGTH + 1];
     char notif_pipe_path[MAX_PIPE_PATH_LENGTH + 1];
+    unsigned char codecs;    // CODEC_BIT mask announced in OP_CODE_CONNECT
 } client_con_req_t;
 
 typedef struct {
@@ -99,6 +272,7 @@ typedef struct {
     pthread_mutex_t mutex;
     sem_t sem_empty; // controla slots disponíveis
     sem_t sem_full;  // controla pedidos disponíveis
+    int closed;      // fechada: queue_remove deixa de devolver pedidos
 } client_queue_t;
 
 /*Move pacman/monster in a certain direction on the board must check for boundaries, walls and other monsters
@@ -118,12 +292,44 @@ int load_pacman(board_t* board);
 int load_ghost(board_t* board);
 
 /*
-Fils the board with the information coming from the file
+Fils the board with the information coming from the file.
+Returns 0, or -1 if the level could not be loaded (unload_level frees the rest)
 */
 int load_level(session_t* session, char* filename, char* dirname, int accumulated_points);
 // Unloads levels loaded by load_level
 void unload_level(board_t * board);
 
+/*Allocates the tile grid for board->width x board->height, every tile unset*/
+int board_alloc_tiles(board_t* board);
+
+/*Allocates the tiles of the band holding row y, filled with walls*/
+int board_open_band(board_t* board, int y);
+
+/*Frees the all-wall tiles of the band holding row y, sharing solid_tile instead*/
+void board_seal_band(board_t* board, int y);
+
+/*Cell (x, y), unsharing its tile first if it is solid. NULL if out of memory*/
+cell_t* board_cell_mut(board_t* board, int x, int y);
+
+/*Builds the bit planes from the cells read by the parser*/
+int board_build_planes(board_t* board);
+
+/*Changes the occupant of (x, y), keeping the pacman/ghost planes in sync*/
+void board_set_content(board_t* board, int x, int y, cell_t content);
+
+/*Index of the live pacman at (x, y), or -1*/
+int board_pacman_at(board_t* board, int x, int y);
+
+/*Index of a ghost at (x, y), or -1*/
+int board_ghost_at(board_t* board, int x, int y);
+
+/*Number of dots still on the board*/
+int board_dots_left(board_t* board);
+
+/*Number of the starting dots before (x, y) in row-major order: the bit of a dot
+in board->eaten, or with x = width the first dot of the next row*/
+int board_dot_index(board_t* board, int x, int y);
+
 void print_board(board_t* board);
 
 
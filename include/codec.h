@@ -0,0 +1,24 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+
+// Encodings of the display chars of a full board frame, named by the codec byte of the frame header
+enum {
+  CODEC_RAW = 0,   // one byte per cell
+  CODEC_RLE = 1,   // count - 1 (1 byte) + char, runs of up to 256 equal cells
+  CODEC_PACK4 = 2, // two cells per byte, low nibble first (cell alphabet below 16 symbols)
+  N_CODECS
+};
+
+#define CODEC_BIT(codec) (1u << (codec))
+#define CODEC_ALL (CODEC_BIT(CODEC_RAW) | CODEC_BIT(CODEC_RLE) | CODEC_BIT(CODEC_PACK4))
+
+/*Encodes n cells into out. Returns the bytes written, or -1 if they do not
+fit in max or a cell cannot be represented by the codec*/
+int codec_encode(int codec, const char *cells, size_t n, unsigned char *out, size_t max);
+
+/*Decodes len bytes into exactly n cells. Returns 0, or -1 on a malformed input*/
+int codec_decode(int codec, const unsigned char *in, size_t len, char *cells, size_t n);
+
+#endif // CODEC_H
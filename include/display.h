@@ -17,8 +17,13 @@ Potential Structures for ncurses
 /*Initialize everything ncurses requires*/
 int terminal_init();
 
+/*Draws a frame, redrawing only the cells that changed since the last one.
+Call from a single thread*/
 void draw_board_client(Board board);
 
+/*Forgets the last drawn frame, so the next one is drawn whole*/
+void display_invalidate(void);
+
 char* get_board_displayed(board_t* board);
 
 /*Draw the board on the screen*/
@@ -39,6 +44,9 @@ void draw(char c, int colour_i, int pos_x, int pos_y);
 /*Call ncurses refresh() to update the screen*/
 void refresh_screen();
 
+/*get_input() result when the terminal was resized (ncurses KEY_RESIZE)*/
+#define INPUT_RESIZE '\001'
+
 /*Ncurses will be reading the player's inputs*/
 char get_input();
 
@@ -46,4 +54,7 @@ void terminal_cleanup();
 
 void set_timeout(int tempo_ms);
 
+/*Cells of the board that fit on the terminal, below the title and above the score*/
+void terminal_board_size(int *width, int *height);
+
 #endif
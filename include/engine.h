@@ -0,0 +1,72 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "board.h"
+
+#define CONTINUE_PLAY 0
+#define NEXT_LEVEL 1
+#define QUIT_GAME 2
+#define LOAD_BACKUP 3
+#define CREATE_BACKUP 4
+
+#define MAX_CATCHUP_TICKS 2 // missed mover deadlines replayed before skipping ahead
+#define HEARTBEAT_MS 1000   // longest gap between two frames of an idle board
+
+/*
+Tick engine: every session advances in one ordered step (pacman input,
+ghosts by index, collisions, frame) over the movers whose timers on the
+worker timing wheel expired at that instant. A state frame is only sent when
+the step changed the board version, or by the heartbeat timer; the static
+layer goes out once per level.
+*/
+
+/*Sets the heartbeat period (ms) of every session. Call before the workers start*/
+void engine_set_heartbeat(int ms);
+
+/*Sets how many plays beyond the next one a session keeps (0: only the newest
+play counts, 1: one queued turn). Call before the workers start*/
+void engine_set_input_queue(int turns);
+
+/*Opens the levels directory and loads the first level.
+Returns 1 while the session has a level to play, 0 once the game is over*/
+int engine_begin_game(session_t* sess);
+
+/*Finishes the current level with result (NEXT_LEVEL or QUIT_GAME) and loads the next one.
+Returns 1 while the session has a level to play, 0 once the game is over*/
+int engine_end_level(session_t* sess, int result);
+
+/*Schedules the pacman, ghost and frame timers after load_level*/
+void engine_start_level(session_t* sess);
+
+/*Marks the mover of an expired timer as due and returns its session.
+Safe to call from any worker: it only sets the atomic due flags*/
+session_t* engine_timer_fired(wheel_timer_t* t);
+
+/*Moves every pending timer of the session to another wheel (migration)*/
+void engine_move_timers(session_t* sess, timing_wheel_t* to);
+
+/*Runs every due mover of the session. Returns CONTINUE_PLAY, NEXT_LEVEL or QUIT_GAME*/
+int engine_step(session_t* sess);
+
+/*Drains the (non-blocking) req_fd into the session input mailbox.
+Returns 1 if the session must step now (quit, disconnect or EOF)*/
+int engine_read_requests(session_t* sess);
+
+/*Publishes the session snapshot (seqlock). Called by the exec_lock holder after every change*/
+void engine_publish(session_t* sess);
+
+/*Lock-free copy of the last published snapshot, for readers on any thread*/
+void engine_read_snapshot(session_t* sess, session_snapshot_t* out);
+
+/*Queues the current state (and the level first, if the client needs it) and
+writes as much as the pipe takes*/
+int send_board_update(session_t* sess);
+
+/*Sends a frame if the board changed since the last one (or force is set) and the
+previous frame is out. Returns -1 on a write error*/
+int engine_send_changes(session_t* sess, int force);
+
+/*Writes queued frames. Returns 0 when empty, 1 if bytes are still pending, -1 on error*/
+int engine_flush(session_t* sess);
+
+#endif
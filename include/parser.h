@@ -1,10 +1,25 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stddef.h>
 #include "board.h"
-#define MAX_COMMAND_LENGTH 256
+#define LINE_READ_SIZE 4096
 
-int read_line(int fd, char* buffer);
+// Buffered line reader; lines grow as long as they need to be
+typedef struct {
+    int fd;
+    char buf[LINE_READ_SIZE];
+    size_t pos, len;
+    char* line; // current line, '\0' terminated, owned by the reader
+    size_t cap;
+} line_reader_t;
+
+void reader_init(line_reader_t* r, int fd);
+void reader_free(line_reader_t* r);
+
+/*Reads the next line into r->line. Returns its length, 0 on an empty line or
+end of file, -1 on a read or allocation error*/
+int read_line(line_reader_t* r);
 int read_level(board_t* board, char* filename, char* dirname);
 int read_pacman(board_t* board, int points);
 int read_ghosts(board_t* board);
@@ -7,7 +7,67 @@ enum {
   OP_CODE_CONNECT = 1,
   OP_CODE_DISCONNECT = 2,
   OP_CODE_PLAY = 3,
-  OP_CODE_BOARD = 4,
+  OP_CODE_LEVEL = 4,   // server -> client: static layer of a level
+  OP_CODE_STATE = 5,   // server -> client: everything that moves
+  OP_CODE_RESYNC = 6,  // client -> server: lost track of the board, send the level again
+  OP_CODE_VIEWPORT = 7, // client -> server: size of the window it draws
+  OP_CODE_PLAY_BATCH = 8, // client -> server: scripted plays, run on the pacman's ticks
 };
 
-#endif
\ No newline at end of file
+#define PROTOCOL_VERSION 3
+
+/*
+OP_CODE_CONNECT: OP(1) + req path(40) + notif path(40) + codecs(1), the
+CODEC_BIT mask (codec.h) of board encodings the client decodes.
+
+Connect reply: OP_CODE_CONNECT(1) + result(1, 0 on success), the first
+bytes on the notification pipe. It is the only unframed server -> client
+message; a non-zero result is followed by the server closing the pipe.
+
+Every later server -> client message is a frame that starts with a fixed
+FRAME_HEADER_SIZE header:
+OP(1) + PROTOCOL_VERSION(1) + codec(1) + flags(1, zero) + payload length(4).
+Every integer on the wire is little-endian: 32 bit, 16 bit for coordinates.
+
+OP_CODE_LEVEL payload: width, height, tempo, n_dots, input_queue
+(LEVEL_FIELDS ints; input_queue is 1..INPUT_QUEUE_MAX) followed by the width * height static chars ('#', '@', '.' or ' '),
+encoded with the codec of the header (always one the client announced).
+n_dots is the number of '.' in it. Sent when a level starts and after
+OP_CODE_RESYNC.
+
+OP_CODE_PLAY: OP(1) + command(1) + seq(4), seq counting up from 1 per
+connection so the client can match its predicted moves with state frames.
+The server keeps the input_queue plays of OP_CODE_LEVEL not applied yet;
+once full, a new play replaces the newest one, which is then never applied.
+
+OP_CODE_PLAY_BATCH: OP(1) + count(2) + seq(4) + count * (wait(2) +
+command(1)), at most MAX_BATCH_PLAYS plays so a batch is one atomic pipe
+write. Play i has seq + i. The server queues them behind earlier batches
+and runs each one after idling wait pacman ticks since the previous play.
+A bigger count, or a batch that does not fit in the SCRIPT_QUEUE_SIZE
+plays still queued, is a protocol error and ends the session: clients
+keep fewer plays than that unacked.
+
+OP_CODE_VIEWPORT: OP(1) + width(2) + height(2), the cells the client
+draws; 0 x 0 (the default) for the whole board.
+
+OP_CODE_STATE payload: victory, game_over, points, n_pacmans, n_ghosts,
+ack (STATE_FIELDS ints; ack is the highest seq applied, from OP_CODE_PLAY
+or OP_CODE_PLAY_BATCH, 0 before the first), the window x + y + width + height, then x + y of
+every live pacman and then every ghost inside the window, then the eaten
+bitmap of the window: one bit per starting dot in it, row-major inside
+the window, bit k % 8 of byte k / 8 set once dot k was eaten. The window
+is the viewport kept around pacman (or the whole board) and slides as it
+moves. The board is the static layer without the eaten dots, then ghosts,
+then pacmans on top.
+*/
+#define FRAME_HEADER_SIZE 8
+#define PLAY_BATCH_HEADER 7
+#define PLAY_BATCH_ENTRY 3
+#define MAX_BATCH_PLAYS 512
+#define SCRIPT_QUEUE_SIZE 1024 // batched plays the server holds per session
+#define INPUT_QUEUE_MAX 2 // plays kept for the pacman: the next one plus one queued turn
+#define LEVEL_FIELDS 5
+#define STATE_FIELDS 6
+
+#endif
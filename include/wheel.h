@@ -0,0 +1,63 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <pthread.h>
+
+/*
+Hierarchical timing wheel (1 ms resolution, 4 levels of 64 slots).
+Every worker keeps one and schedules the pacman, ghost and frame timers
+of all its sessions on it: insert, cancel and expire are O(1).
+All operations take the wheel lock, so a session stepped by another
+worker can still reschedule its timers here.
+*/
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
+enum {
+    TIMER_PACMAN = 0,
+    TIMER_GHOST = 1,
+    TIMER_FRAME = 2,
+};
+
+struct session;
+
+typedef struct wheel_timer {
+    struct wheel_timer *next, *prev; // slot list, NULL when not scheduled
+    unsigned long long expires;      // absolute wheel time in ms
+    unsigned long long fired_at;     // wheel time it was expired at
+    int kind;                        // TIMER_PACMAN, TIMER_GHOST or TIMER_FRAME
+    int index;                       // pacman/ghost index in the board
+    struct session *sess;
+} wheel_timer_t;
+
+// Called for each expired timer, under the wheel lock
+typedef void (*wheel_fire_fn)(wheel_timer_t* t, void* arg);
+
+typedef struct {
+    pthread_mutex_t lock;
+    unsigned long long now;          // time of the last advance
+    int count;                       // scheduled timers
+    wheel_timer_t slots[WHEEL_LEVELS][WHEEL_SLOTS]; // list heads
+} timing_wheel_t;
+
+/*Current CLOCK_MONOTONIC time in ms, the time base of every wheel*/
+unsigned long long wheel_clock_ms(void);
+
+void wheel_init(timing_wheel_t* wheel, unsigned long long now);
+
+/*Schedules t to expire at the absolute time expires (rescheduling it if it was pending)*/
+void wheel_add(timing_wheel_t* wheel, wheel_timer_t* t, unsigned long long expires);
+
+/*Returns 1 if t was pending*/
+int wheel_cancel(timing_wheel_t* wheel, wheel_timer_t* t);
+
+/*Moves the wheel to now and calls fire for every timer that expired, in expiry order*/
+void wheel_advance(timing_wheel_t* wheel, unsigned long long now, wheel_fire_fn fire, void* arg);
+
+/*Earliest time the wheel has work to do, or 0 when it is empty*/
+unsigned long long wheel_next(timing_wheel_t* wheel);
+
+#endif
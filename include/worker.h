@@ -0,0 +1,64 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "board.h"
+#include "wheel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+Event loops: a fixed pool of workers multiplexes every session's request
+FIFO and notification FIFO with epoll, and drives all their movers from
+one timing wheel, so the number of sessions is no longer tied to the
+number of threads or kernel timers.
+
+Each worker is a shard: expired timers queue their sessions on its run
+queue. A backed-up shard wakes an idle one, which steals half of the
+queue and runs those steps (sess->exec_lock keeps a session on one
+worker at a time). A session stolen MIGRATE_AFTER_STEALS times in a row
+moves to the thief, fds and timers included.
+*/
+
+typedef struct worker {
+    int id;
+    int epfd;
+    int wake_fd;            // eventfd signalled when the inbox has sessions
+    io_event_t wake_ev;
+    int timer_fd;           // fires when the wheel has timers due
+    io_event_t timer_ev;
+    unsigned long long armed; // expiry timer_fd is set to, 0 when disarmed
+    timing_wheel_t wheel;   // pacman, ghost and frame timers of every session here
+    pthread_t tid;
+    int pinned;             // bound to CPU id % cores
+    atomic_int idle;        // blocked in epoll_wait
+
+    pthread_mutex_t lock;   // protects inbox, n_sessions and the run queue
+    session_t *inbox;       // sessions handed over by the acceptor
+    int n_sessions;
+    session_t *run_head, *run_tail; // due sessions, linked through ready_next
+    atomic_int run_len;
+} worker_t;
+
+/*Starts n_workers event loops serving the max_games session slots,
+optionally pinning each one to its own CPU*/
+int workers_start(session_t* sessions, int max_games, int n_workers, int pin_cpus);
+
+/*Blocks until a session slot is free and returns it, or NULL once
+workers_close_slots was called*/
+session_t* workers_acquire_slot(void);
+
+/*Wakes and fails every workers_acquire_slot, now and later*/
+void workers_close_slots(void);
+
+/*Stops and joins every worker. Sessions still attached are left as they
+are: call it before freeing them*/
+void workers_stop(void);
+
+/*Gives back a slot that was never attached*/
+void workers_release_slot(session_t* sess);
+
+/*Hands a connected session (req_fd/notif_fd open) to the least loaded worker*/
+void workers_attach(session_t* sess);
+
+#endif
@@ -2,6 +2,7 @@
 #include "protocol.h"
 #include "debug.h"
 #include "common.h"
+#include "codec.h"
 
 #include <fcntl.h>
 #include <errno.h>
@@ -10,17 +11,309 @@
 #include <stdio.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 
+#define INPUT_CHUNK 4096     // read minimo do notif pipe: normalmente um por frame
 
-struct Session {
+typedef struct {
+  uint32_t seq;
+  char command;
+} pending_play_t;
+
+
+// Uma ligacao ao servidor. Cada handle tem o seu estado e os seus locks:
+// handles diferentes nunca partilham nada
+struct pacman_client {
   int id;
+  // wlock serializa as escritas no req pipe e protege o fd e os paths
+  pthread_mutex_t wlock;
   int req_pipe;
   int notif_pipe;
   char req_pipe_path[MAX_PIPE_PATH_LENGTH + 1];
   char notif_pipe_path[MAX_PIPE_PATH_LENGTH + 1];
+  // so a thread que recebe mexe daqui ate frame_ready
+  // bytes do notif pipe por descodificar: in[in_pos, in_len). Cresce ate
+  // caber o maior frame e e reutilizado entre frames
+  unsigned char *in;
+  size_t in_pos, in_len, in_cap;
+  int frame_ready;          // estado aplicado que receive_board_update ainda nao entregou
+
+  // o lock protege tudo o que vem a seguir
+  pthread_mutex_t lock;
+  // camada estatica do nivel (OP_CODE_LEVEL)
+  char *level;
+  int cells_cap;
+  int width, height, tempo;
+  int input_queue;          // jogadas que a caixa do servidor guarda
+  int synced;               // temos a camada estatica do nivel atual
+  // previsao
+  char *base;               // janela do ultimo estado, sem o nosso pacman
+  Board state;              // campos do ultimo estado (data nao usado)
+  int win_x, win_y;         // origem da janela no tabuleiro
+  int pac_x, pac_y;         // posicao confirmada do pacman, -1 se nao esta na janela
+  int have_state;
+  uint32_t play_seq;        // seq da ultima jogada enviada
+  uint32_t play_ack;        // seq da ultima jogada que o servidor aplicou
+  pending_play_t pending[INPUT_QUEUE_MAX]; // enviadas e ainda nao confirmadas, como na caixa do servidor
+  int n_pending;
 };
 
-static struct Session session = {.id = -1, .req_pipe = -1, .notif_pipe = -1};
+// Escreve um pedido inteiro no req pipe. Devolve 0, ou -1 se ja nao ha ligacao
+static int send_request(pacman_client_t *client, const void *msg, size_t len) {
+  pthread_mutex_lock(&client->wlock);
+  int ret = client->req_pipe >= 0 ? write_full(client->req_pipe, msg, len) : -1;
+  pthread_mutex_unlock(&client->wlock);
+  return ret < 0 ? -1 : 0;
+}
+
+static void request_resync(pacman_client_t *client) {
+  unsigned char op = OP_CODE_RESYNC;
+  (void)send_request(client, &op, 1);
+}
+
+// Bytes que faltam para o frame em curso ficar completo (pelo menos o cabecalho)
+static size_t input_missing(const pacman_client_t *client) {
+  size_t avail = client->in_len - client->in_pos;
+  size_t need = FRAME_HEADER_SIZE;
+  if (avail >= FRAME_HEADER_SIZE) need += get_le32(client->in + client->in_pos + 4);
+  return need > avail ? need - avail : 0;
+}
+
+// Garante espaco para mais n bytes no fim do buffer de entrada
+static int reserve_input(pacman_client_t *client, size_t n) {
+  if (client->in_pos > 0) {
+    client->in_len -= client->in_pos;
+    memmove(client->in, client->in + client->in_pos, client->in_len);
+    client->in_pos = 0;
+  }
+  if (client->in_len + n <= client->in_cap) return 0;
+
+  unsigned char *in = realloc(client->in, client->in_len + n);
+  if (!in) return -1;
+  client->in = in;
+  client->in_cap = client->in_len + n;
+  return 0;
+}
+
+// Um read do notif pipe para o buffer de entrada, com espaco para o frame em
+// curso inteiro. Devolve os bytes lidos, 0 em EOF ou -1 em erro
+static ssize_t read_input(pacman_client_t *client) {
+  size_t want = input_missing(client);
+  if (want < INPUT_CHUNK) want = INPUT_CHUNK;
+  if (reserve_input(client, want) < 0) return -1;
+
+  for (;;) {
+    ssize_t r = read(client->notif_pipe, client->in + client->in_len, client->in_cap - client->in_len);
+    if (r < 0 && errno == EINTR) continue;
+    if (r > 0) client->in_len += (size_t)r;
+    return r;
+  }
+}
+
+// Guarda a camada estatica de um OP_CODE_LEVEL. Devolve 0, ou -1 se o frame nao serve
+static int store_level(pacman_client_t *client, const unsigned char *p, size_t len, int codec) {
+  size_t head = 4 * LEVEL_FIELDS;
+  if (len < head) return -1;
+
+  int width = (int)get_le32(p);
+  int height = (int)get_le32(p + 4);
+  int n_dots = (int)get_le32(p + 12);
+  int input_queue = (int)get_le32(p + 16);
+  if (input_queue < 1 || input_queue > INPUT_QUEUE_MAX) return -1;
+  if (width <= 0 || height <= 0 || width > UINT16_MAX || height > UINT16_MAX) return -1;
+  if ((size_t)width * (size_t)height > INT_MAX) return -1;
+  int n = width * height;
+
+  if (n > client->cells_cap) {
+    char *level = realloc(client->level, (size_t)n);
+    if (!level) return -1;
+    client->level = level;
+    char *base = realloc(client->base, (size_t)n);
+    if (!base) return -1;
+    client->base = base;
+    client->cells_cap = n;
+  }
+  if (codec_decode(codec, p + head, len - head, client->level, (size_t)n) < 0) return -1;
+
+  int dots = 0;
+  for (int i = 0; i < n; i++) dots += client->level[i] == '.';
+  if (dots != n_dots) return -1;
+
+  client->width = width;
+  client->height = height;
+  client->tempo = (int)get_le32(p + 8);
+  client->input_queue = input_queue;
+  client->have_state = 0;
+  return 0;
+}
+
+// Entidade na base, com coordenadas do tabuleiro. Devolve -1 se estiver fora da janela
+static int put_entity(pacman_client_t *client, const unsigned char *pos, int x0, int y0, int w, int h, char ch) {
+  int x = get_le16(pos) - x0, y = get_le16(pos + 2) - y0;
+  if (x < 0 || x >= w || y < 0 || y >= h) return -1;
+  client->base[y * w + x] = ch;
+  return 0;
+}
+
+// Esquece as jogadas que o servidor ja aplicou (seq <= ack, com wrap-around)
+static void drop_acked(pacman_client_t *client, uint32_t ack) {
+  int k = 0;
+  while (k < client->n_pending && (int32_t)(client->pending[k].seq - ack) <= 0) k++;
+  client->n_pending -= k;
+  memmove(client->pending, client->pending + k, (size_t)client->n_pending * sizeof(pending_play_t));
+}
+
+// Compoe a base com as jogadas por confirmar aplicadas ao nosso pacman:
+// parte da posicao confirmada e repete cada W/A/S/D que nao bate numa parede
+static void predict(pacman_client_t *client, char *out) {
+  int w = client->state.width, h = client->state.height;
+  memcpy(out, client->base, (size_t)(w * h));
+  if (client->pac_x < 0) return;
+
+  int x = client->pac_x, y = client->pac_y;
+  for (int i = 0; i < client->n_pending; i++) {
+    int nx = x, ny = y;
+    switch (client->pending[i].command) {
+      case 'W': ny--; break;
+      case 'S': ny++; break;
+      case 'A': nx--; break;
+      case 'D': nx++; break;
+      default: continue;
+    }
+    if (nx < 0 || nx >= client->width || ny < 0 || ny >= client->height) continue;
+    char cell = client->level[ny * client->width + nx];
+    if (cell == '#') continue;
+    x = nx;
+    y = ny;
+
+    // o ponto previsto como comido desaparece ja
+    int vx = x - client->win_x, vy = y - client->win_y;
+    if (vx >= 0 && vx < w && vy >= 0 && vy < h && out[vy * w + vx] == '.') out[vy * w + vx] = ' ';
+    if (cell == '@') break; // o portal muda de nivel: o resto fica para o servidor
+  }
+
+  int vx = x - client->win_x, vy = y - client->win_y;
+  if (vx >= 0 && vx < w && vy >= 0 && vy < h) out[vy * w + vx] = 'C';
+}
+
+// Compoe a janela de um OP_CODE_STATE na base. Devolve 0, ou -1 se o frame nao serve
+static int apply_state(pacman_client_t *client, const unsigned char *p, size_t len) {
+  size_t head = 4 * STATE_FIELDS + 8;
+  client->have_state = 0;
+  if (len < head) return -1;
+
+  uint32_t n_pacmans = get_le32(p + 12), n_ghosts = get_le32(p + 16);
+  const unsigned char *window = p + 4 * STATE_FIELDS;
+  int x0 = get_le16(window), y0 = get_le16(window + 2);
+  int w = get_le16(window + 4), h = get_le16(window + 6);
+  if (w <= 0 || h <= 0 || x0 + w > client->width || y0 + h > client->height) return -1;
+  if (n_pacmans > len || n_ghosts > len || len < head + 4 * (size_t)(n_pacmans + n_ghosts)) return -1;
+
+  const unsigned char *pacmans = p + head;
+  const unsigned char *ghosts = pacmans + 4 * n_pacmans;
+  const unsigned char *eaten = ghosts + 4 * n_ghosts;
+  size_t bitmap = len - (size_t)(eaten - p);
+
+  // janela da camada estatica, sem os pontos comidos
+  size_t k = 0;
+  for (int y = 0; y < h; y++) {
+    const char *src = client->level + (y0 + y) * client->width + x0;
+    char *dst = client->base + y * w;
+    memcpy(dst, src, (size_t)w);
+    for (int x = 0; x < w; x++) {
+      if (dst[x] != '.') continue;
+      if (k / 8 >= bitmap) return -1;
+      if (eaten[k / 8] & (1u << (k % 8))) dst[x] = ' ';
+      k++;
+    }
+  }
+  if ((k + 7) / 8 != bitmap) return -1;
+
+  // mesma prioridade do servidor: pacman por cima de monstro. O primeiro
+  // pacman e o nosso: fica fora da base, a previsao e que o desenha
+  for (uint32_t i = 0; i < n_ghosts; i++) {
+    if (put_entity(client, ghosts + 4 * i, x0, y0, w, h, 'M') < 0) return -1;
+  }
+  for (uint32_t i = 1; i < n_pacmans; i++) {
+    if (put_entity(client, pacmans + 4 * i, x0, y0, w, h, 'C') < 0) return -1;
+  }
+  client->pac_x = client->pac_y = -1;
+  if (n_pacmans > 0) {
+    int x = get_le16(pacmans), y = get_le16(pacmans + 2);
+    if (x < x0 || x >= x0 + w || y < y0 || y >= y0 + h) return -1;
+    client->pac_x = x;
+    client->pac_y = y;
+  }
+  client->win_x = x0;
+  client->win_y = y0;
+  client->play_ack = get_le32(p + 20);
+  drop_acked(client, client->play_ack);
+
+  client->state.width = w;
+  client->state.height = h;
+  client->state.tempo = client->tempo;
+  client->state.victory = (int)get_le32(p);
+  client->state.game_over = (int)get_le32(p + 4);
+  client->state.accumulated_points = (int)get_le32(p + 8);
+  client->have_state = 1;
+  return 0;
+}
+
+// Trata os frames completos do buffer de entrada, ate max frames de estado.
+// Devolve os frames de estado aplicados, ou -1 num frame invalido
+static int decode_frames(pacman_client_t *client, int max) {
+  int states = 0;
+
+  while (states < max) {
+    size_t avail = client->in_len - client->in_pos;
+    if (avail < FRAME_HEADER_SIZE) break;
+    const unsigned char *head = client->in + client->in_pos;
+    if (head[1] != PROTOCOL_VERSION) {
+      debug("Unsupported protocol version %d\n", head[1]);
+      return -1;
+    }
+    size_t len = get_le32(head + 4);
+    if (avail - FRAME_HEADER_SIZE < len) break;
+
+    // o payload continua no buffer ate ao proximo read
+    int op = head[0], codec = head[2];
+    const unsigned char *p = head + FRAME_HEADER_SIZE;
+    client->in_pos += FRAME_HEADER_SIZE + len;
+
+    debug("Received op=%d\n", op);
+    if (op != OP_CODE_LEVEL && op != OP_CODE_STATE) {
+      debug("Invalid op code, expected %d or %d\n", OP_CODE_LEVEL, OP_CODE_STATE);
+      return -1;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    if (op == OP_CODE_LEVEL) {
+      int synced = client->synced = store_level(client, p, len, codec) == 0;
+      pthread_mutex_unlock(&client->lock);
+      if (!synced) {
+        debug("Malformed level frame (codec %d)\n", codec);
+        request_resync(client);
+      }
+      continue;
+    }
+
+    // sem nivel nao ha onde compor: o pedido de resync ja foi feito
+    int was_synced = client->synced;
+    int applied = was_synced && apply_state(client, p, len) == 0;
+    if (was_synced && !applied) client->synced = 0;
+    pthread_mutex_unlock(&client->lock);
+    if (was_synced && !applied) {
+      debug("Malformed state frame\n");
+      request_resync(client);
+    }
+    if (applied) {
+      client->frame_ready = 1;
+      states++;
+    }
+  }
+  return states;
+}
 
 static int make_fifo_if_needed(const char *path) {
   if (mkfifo(path, 0666) < 0) {
@@ -30,153 +323,268 @@ static int make_fifo_if_needed(const char *path) {
   return 0;
 }
 
-int pacman_connect(const char *req_pipe_path, const char *notif_pipe_path, const char *server_pipe_path){
-  
+// Copia o estado composto, com a previsao, para o buffer do chamador. Chamar com o lock
+static int copy_state(pacman_client_t *client, Board *board, char *cells, size_t cap) {
+  *board = client->state;
+  board->data = NULL;
+  if ((size_t)(client->state.width * client->state.height) > cap) return -1;
+  predict(client, cells);
+  board->data = cells;
+  return 1;
+}
+
+pacman_client_t *pacman_connect(const char *req_pipe_path, const char *notif_pipe_path, const char *server_pipe_path){
+  pacman_client_t *client = calloc(1, sizeof(pacman_client_t));
+  if (!client) return NULL;
+  client->id = -1;
+  client->req_pipe = -1;
+  client->notif_pipe = -1;
+  client->input_queue = INPUT_QUEUE_MAX;
+  pthread_mutex_init(&client->wlock, NULL);
+  pthread_mutex_init(&client->lock, NULL);
+
   // guardar paths
-  strncpy(session.req_pipe_path, req_pipe_path, MAX_PIPE_PATH_LENGTH);
-  session.req_pipe_path[MAX_PIPE_PATH_LENGTH] = '\0';
-  strncpy(session.notif_pipe_path, notif_pipe_path, MAX_PIPE_PATH_LENGTH);
-  session.notif_pipe_path[MAX_PIPE_PATH_LENGTH] = '\0';
+  strncpy(client->req_pipe_path, req_pipe_path, MAX_PIPE_PATH_LENGTH);
+  client->req_pipe_path[MAX_PIPE_PATH_LENGTH] = '\0';
+  strncpy(client->notif_pipe_path, notif_pipe_path, MAX_PIPE_PATH_LENGTH);
+  client->notif_pipe_path[MAX_PIPE_PATH_LENGTH] = '\0';
 
   // limpar restos de FIFOs antigos
-  unlink(session.req_pipe_path);
-  unlink(session.notif_pipe_path);
+  unlink(client->req_pipe_path);
+  unlink(client->notif_pipe_path);
 
   // criar FIFOs do cliente
-  if (make_fifo_if_needed(session.req_pipe_path) < 0) return 1;
-  if (make_fifo_if_needed(session.notif_pipe_path) < 0) {
-    unlink(session.req_pipe_path);
-    return 1;
+  if (make_fifo_if_needed(client->req_pipe_path) < 0) goto fail;
+  if (make_fifo_if_needed(client->notif_pipe_path) < 0) {
+    unlink(client->req_pipe_path);
+    goto fail;
   }
 
   // abrir FIFO do servidor e enviar CONNECT: OP(1) | req | notif
   int reg_fd = open(server_pipe_path, O_WRONLY);
   if (reg_fd < 0) goto fail_fifos;
 
-  unsigned char op = OP_CODE_CONNECT;
+  // um so write (< PIPE_BUF): pedidos de clientes diferentes nunca se misturam
+  char msg[1 + 2 * MAX_PIPE_PATH_LENGTH + 1];
+  char *req40 = msg + 1;
+  char *notif40 = msg + 1 + MAX_PIPE_PATH_LENGTH;
 
-  char req40[MAX_PIPE_PATH_LENGTH];
-  char notif40[MAX_PIPE_PATH_LENGTH];
-  
-  memcpy(req40, session.req_pipe_path, MAX_PIPE_PATH_LENGTH);
+  msg[0] = OP_CODE_CONNECT;
+  memcpy(req40, client->req_pipe_path, MAX_PIPE_PATH_LENGTH);
   req40[MAX_PIPE_PATH_LENGTH - 1] = '\0';
-  memcpy(notif40, session.notif_pipe_path, MAX_PIPE_PATH_LENGTH);
+  memcpy(notif40, client->notif_pipe_path, MAX_PIPE_PATH_LENGTH);
   notif40[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+  msg[sizeof(msg) - 1] = (char)CODEC_ALL; // codecs que sabemos descodificar
 
-  if (write_full(reg_fd, &op, 1) < 0 ||
-      write_full(reg_fd, req40, sizeof(req40)) < 0 ||
-      write_full(reg_fd, notif40, sizeof(notif40)) < 0) {
+  if (write_full(reg_fd, msg, sizeof(msg)) < 0) {
     close(reg_fd);
     goto fail_fifos;
   }
   close(reg_fd);
 
   // abrir req primeiro (evita deadlock)
-  session.req_pipe = open(session.req_pipe_path, O_WRONLY);
-  if (session.req_pipe < 0) goto fail_fifos;
+  client->req_pipe = open(client->req_pipe_path, O_WRONLY);
+  if (client->req_pipe < 0) goto fail_fifos;
 
   // abrir notif
-  session.notif_pipe = open(session.notif_pipe_path, O_RDONLY);
-  if (session.notif_pipe < 0) {
-    close(session.req_pipe);
-    session.req_pipe = -1;
+  client->notif_pipe = open(client->notif_pipe_path, O_RDONLY);
+  if (client->notif_pipe < 0) {
+    close(client->req_pipe);
     goto fail_fifos;
   }
 
-  unsigned char ack_op = 0, result = 1;
-  if (read_full(session.notif_pipe, &ack_op, 1) != 1 || 
-      read_full(session.notif_pipe, &result, 1) != 1 || 
-      ack_op != OP_CODE_CONNECT || result != 0) {
-    close(session.req_pipe);
-    close(session.notif_pipe);
-    session.req_pipe = -1;
-    session.notif_pipe = -1;
+  // o ack vem pelo buffer de entrada: os frames que chegarem com ele ficam la
+  while (client->in_len < 2) {
+    if (read_input(client) <= 0) break;
+  }
+  if (client->in_len < 2 || client->in[0] != OP_CODE_CONNECT || client->in[1] != 0) {
+    free(client->in);
+    close(client->req_pipe);
+    close(client->notif_pipe);
     goto fail_fifos;
   }
+  client->in_pos = 2;
 
-  session.id = 0;
-  return 0;
+  client->id = 0;
+  return client;
 
   fail_fifos:
-    unlink(session.req_pipe_path);
-    unlink(session.notif_pipe_path);
-    session.req_pipe_path[0] = '\0';
-    session.notif_pipe_path[0] = '\0';
-    return 1;
+    unlink(client->req_pipe_path);
+    unlink(client->notif_pipe_path);
+  fail:
+    pthread_mutex_destroy(&client->wlock);
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+    return NULL;
 }
 
-int pacman_play(char command) {
+int pacman_play(pacman_client_t *client, char command) {
 
-  if (session.req_pipe < 0) return -1;
+  // um so write: um OP_CODE_RESYNC nunca fica entre o op e o comando
+  unsigned char msg[6] = {OP_CODE_PLAY, (unsigned char)command};
 
-  unsigned char op = OP_CODE_PLAY;
-  unsigned char cmd = (unsigned char)command;
+  // o wlock mantem os seqs pela ordem em que chegam ao servidor
+  pthread_mutex_lock(&client->wlock);
+  pthread_mutex_lock(&client->lock);
+  uint32_t seq = ++client->play_seq;
+  // como a caixa do servidor ('Q' nao entra): cheia, a nova substitui a mais
+  // recente, que nunca vai ser aplicada
+  if (command != 'Q') {
+    int slot = client->n_pending < client->input_queue ? client->n_pending++ : client->input_queue - 1;
+    client->pending[slot] = (pending_play_t){seq, command};
+  }
+  pthread_mutex_unlock(&client->lock);
 
-  if (write_full(session.req_pipe, &op, 1) < 0) return -1;
-  if (write_full(session.req_pipe, &cmd, 1) < 0) return -1;
+  put_le32(msg + 2, seq);
+  int ret = client->req_pipe >= 0 ? write_full(client->req_pipe, msg, sizeof(msg)) : -1;
+  pthread_mutex_unlock(&client->wlock);
 
-  return 0; 
+  return ret < 0 ? -1 : 0;
 }
 
-int pacman_disconnect() {
-  if (session.req_pipe >= 0) {
-    unsigned char op = OP_CODE_DISCONNECT;
-    (void)write_full(session.req_pipe, &op, 1);
+int pacman_play_batch(pacman_client_t *client, const char *commands, const unsigned short *waits, int n) {
+  if (n <= 0 || n > MAX_BATCH_PLAYS) return -1;
+
+  // um so write (< PIPE_BUF), como no OP_CODE_PLAY
+  unsigned char msg[PLAY_BATCH_HEADER + PLAY_BATCH_ENTRY * MAX_BATCH_PLAYS];
+  msg[0] = OP_CODE_PLAY_BATCH;
+  put_le16(msg + 1, (uint16_t)n);
+
+  unsigned char *entry = msg + PLAY_BATCH_HEADER;
+  for (int i = 0; i < n; i++, entry += PLAY_BATCH_ENTRY) {
+    put_le16(entry, waits ? waits[i] : 0);
+    entry[2] = (unsigned char)commands[i];
   }
 
-  if (session.req_pipe >= 0) close(session.req_pipe);
-  if (session.notif_pipe >= 0) close(session.notif_pipe);
+  // as jogadas do lote correm no futuro: nao entram na previsao
+  pthread_mutex_lock(&client->wlock);
+  pthread_mutex_lock(&client->lock);
+  uint32_t seq = client->play_seq + 1;
+  client->play_seq += (uint32_t)n;
+  pthread_mutex_unlock(&client->lock);
+
+  put_le32(msg + 3, seq);
+  size_t len = (size_t)(entry - msg);
+  int ret = client->req_pipe >= 0 ? write_full(client->req_pipe, msg, len) : -1;
+  pthread_mutex_unlock(&client->wlock);
+
+  return ret < 0 ? -1 : 0;
+}
+
+int pacman_unacked(pacman_client_t *client) {
+  pthread_mutex_lock(&client->lock);
+  int n = (int)(client->play_seq - client->play_ack);
+  pthread_mutex_unlock(&client->lock);
+  return n;
+}
+
+int pacman_predict(pacman_client_t *client, Board *board, char *cells, size_t cap) {
+  int ret = 0;
+  memset(board, 0, sizeof(Board));
 
-  session.req_pipe = -1;
-  session.notif_pipe = -1;
-  session.id = -1;
+  pthread_mutex_lock(&client->lock);
+  if (client->synced && client->have_state) ret = copy_state(client, board, cells, cap);
+  pthread_mutex_unlock(&client->lock);
+  return ret;
+}
+
+int pacman_set_viewport(pacman_client_t *client, int width, int height) {
+  if (width < 0 || width > UINT16_MAX || height < 0 || height > UINT16_MAX) return -1;
+
+  unsigned char msg[5] = {OP_CODE_VIEWPORT};
+  put_le16(msg + 1, (uint16_t)width);
+  put_le16(msg + 3, (uint16_t)height);
+
+  return send_request(client, msg, sizeof(msg));
+}
 
-  if (session.req_pipe_path[0] != '\0') unlink(session.req_pipe_path);
-  if (session.notif_pipe_path[0] != '\0') unlink(session.notif_pipe_path);
+int pacman_disconnect(pacman_client_t *client) {
+  pthread_mutex_lock(&client->wlock);
+  if (client->req_pipe >= 0) {
+    unsigned char op = OP_CODE_DISCONNECT;
+    (void)write_full(client->req_pipe, &op, 1);
+    close(client->req_pipe);
+  }
+  client->req_pipe = -1;
+  client->id = -1;
+
+  // o notif pipe fica aberto: a thread que recebe acaba no EOF do servidor
+  if (client->req_pipe_path[0] != '\0') unlink(client->req_pipe_path);
+  if (client->notif_pipe_path[0] != '\0') unlink(client->notif_pipe_path);
 
-  session.req_pipe_path[0] = '\0';
-  session.notif_pipe_path[0] = '\0';
+  client->req_pipe_path[0] = '\0';
+  client->notif_pipe_path[0] = '\0';
+  pthread_mutex_unlock(&client->wlock);
 
   return 0;
 }
 
-Board receive_board_update(void) {
-  Board board;
-  memset(&board, 0, sizeof(Board));
+void pacman_close(pacman_client_t *client) {
+  if (!client) return;
+  pacman_disconnect(client);
+  if (client->notif_pipe >= 0) close(client->notif_pipe);
+
+  free(client->level);
+  free(client->base);
+  free(client->in);
+  pthread_mutex_destroy(&client->wlock);
+  pthread_mutex_destroy(&client->lock);
+  free(client);
+}
+
+int receive_board_update(pacman_client_t *client, Board *board, char *cells, size_t cap) {
+  memset(board, 0, sizeof(Board));
   
-  if (session.notif_pipe < 0) {
+  if (client->notif_pipe < 0) {
     debug("Notification pipe not open\n");
-    return board;
+    return 0;
   }
 
-  unsigned char op = 0;
-  if (read_full(session.notif_pipe, &op, 1) != 1) {
-    debug("EOF or error reading op; stopping client receiver\n");
-    board.data = NULL;
-    return board;
+  for (;;) {
+    // um estado por chamada: o que nao coube da ultima vez vai primeiro
+    if (client->frame_ready) {
+      pthread_mutex_lock(&client->lock);
+      int ret = copy_state(client, board, cells, cap);
+      pthread_mutex_unlock(&client->lock);
+      client->frame_ready = ret < 0;
+      return ret;
+    }
+
+    int states = decode_frames(client, 1);
+    if (states < 0) return 0;
+    if (states > 0) continue;
+
+    if (read_input(client) <= 0) {
+      debug("EOF or error reading frame; stopping client receiver\n");
+      return 0;
+    }
   }
-  debug("Received op=%d\n", op);
-  if (op != OP_CODE_BOARD) { debug("Invalid op code, expected %d\n", OP_CODE_BOARD); return board; }
+}
 
-  if (read_full(session.notif_pipe, &board.width, sizeof(int)) != 1) return board;
-  if (read_full(session.notif_pipe, &board.height, sizeof(int)) != 1) return board;
-  if (read_full(session.notif_pipe, &board.tempo, sizeof(int)) != 1) return board;
-  if (read_full(session.notif_pipe, &board.victory, sizeof(int)) != 1) return board;
-  if (read_full(session.notif_pipe, &board.game_over, sizeof(int)) != 1) return board;
-  if (read_full(session.notif_pipe, &board.accumulated_points, sizeof(int)) != 1) return board;
-  int n = board.width * board.height;
-  if (n <= 0) return board;
+int pacman_notif_fd(pacman_client_t *client) {
+  return client->notif_pipe;
+}
 
-  board.data = (char*)malloc((size_t)(n + 1));
-  if (!board.data) {
-    return board;
-  }
+int pacman_feed(pacman_client_t *client, const void *bytes, size_t n) {
+  if (reserve_input(client, n) < 0) return -1;
+  memcpy(client->in + client->in_len, bytes, n);
+  client->in_len += n;
+
+  // o chamador le o estado mais recente com pacman_predict
+  int states = decode_frames(client, INT_MAX);
+  client->frame_ready = 0;
+  return states;
+}
 
-  if (read_full(session.notif_pipe, board.data, (size_t)n) != 1) {
-    free(board.data);
-    board.data = NULL;
-    return board;
+int pacman_pump(pacman_client_t *client) {
+  if (client->notif_pipe < 0) return -1;
+
+  ssize_t r = read_input(client);
+  if (r <= 0) {
+    debug("EOF or error reading frame; stopping client receiver\n");
+    return -1;
   }
-  
-  return board;
-}
\ No newline at end of file
+  int states = decode_frames(client, INT_MAX);
+  client->frame_ready = 0;
+  return states;
+}
@@ -10,28 +10,105 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <unistd.h>
-#include <pthread.h>
+#include <limits.h>
+#include <signal.h>
 
+pacman_client_t *client;
 Board board;
+size_t board_cap = 0; // bytes allocated for board.data, reused between frames
 bool stop_execution = false;
-int tempo;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond_var = PTHREAD_COND_INITIALIZER;
-bool board_updated = false;
+bool board_updated = false; // ha um frame que a render thread ainda nao desenhou
+bool board_received = false;
+bool resized = false; // o terminal mudou de tamanho: a render thread desenha tudo outra vez
+unsigned long frames_received = 0; // frames do servidor, marcam o ritmo do modo ficheiro
+
+// Copia o frame recebido (da api) para a global. Chamar com o mutex
+static int store_board(Board new_board) {
+    size_t n = (size_t)(new_board.width * new_board.height);
+    if (n > board_cap) {
+        char *data = realloc(board.data, n);
+        if (!data) return -1;
+        board.data = data;
+        board_cap = n;
+    }
+    memcpy(board.data, new_board.data, n);
+
+    char *data = board.data;
+    board = new_board;
+    board.data = data;
+    return 0;
+}
+
+// Unica thread que desenha: acorda com cada frame novo e desenha sempre o mais
+// recente, saltando os que chegaram entretanto
+static void *render_thread(void *arg) {
+    (void)arg;
+    Board frame = {0};
+    size_t frame_cap = 0;
+
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        while (!board_updated && !stop_execution) {
+            pthread_cond_wait(&cond_var, &mutex);
+        }
+        if (!board_updated) break;
+        board_updated = false;
+
+        size_t n = (size_t)(board.width * board.height);
+        if (n > frame_cap) {
+            char *data = realloc(frame.data, n);
+            if (!data) continue;
+            frame.data = data;
+            frame_cap = n;
+        }
+        char *data = frame.data;
+        frame = board;
+        frame.data = data;
+        memcpy(frame.data, board.data, n);
+        bool redraw = resized;
+        resized = false;
+        pthread_mutex_unlock(&mutex);
+
+        if (redraw) display_invalidate();
+        draw_board_client(frame);
+        refresh_screen();
+
+        pthread_mutex_lock(&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    free(frame.data);
+    debug("Returning render thread...\n");
+    return NULL;
+}
 
 static void *receiver_thread(void *arg) {
     (void)arg;
+    Board new_board;
+    char *cells = NULL;
+    size_t cells_cap = 0;
 
     while (true) {
         
-        Board new_board = receive_board_update();
+        int received = receive_board_update(client, &new_board, cells, cells_cap);
+        if (received < 0) {
+            // o frame nao coube: a api guarda-o ate a proxima chamada
+            size_t n = (size_t)(new_board.width * new_board.height);
+            char *data = realloc(cells, n);
+            if (data) {
+                cells = data;
+                cells_cap = n;
+                continue;
+            }
+            received = 0;
+        }
 
-        if (!new_board.data) {
+        if (received == 0) {
             debug("EOF received, stopping execution\n");
-            // EOF - fazer draw com a global que tem o último estado válido
+            // EOF - a render thread fica com o último estado válido
             pthread_mutex_lock(&mutex);
-            draw_board_client(board);
-            refresh_screen();
             stop_execution = true;
             pthread_cond_broadcast(&cond_var);
             pthread_mutex_unlock(&mutex);
@@ -40,20 +117,20 @@ static void *receiver_thread(void *arg) {
 
         // Novo board válido - atualizar a global
         pthread_mutex_lock(&mutex);
-        if (board.data) free(board.data);
-        board = new_board;
-        tempo = new_board.tempo;
+        if (store_board(new_board) < 0) {
+            stop_execution = true;
+            pthread_cond_broadcast(&cond_var);
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
         board_updated = true;
+        board_received = true;
+        frames_received++;
         pthread_cond_broadcast(&cond_var);
         pthread_mutex_unlock(&mutex);
 
-        draw_board_client(board);
-        refresh_screen();
-
         if (new_board.game_over == 1 || new_board.victory == 1) {
             debug("Game ended (game_over=%d, victory=%d)\n", new_board.game_over, new_board.victory);
-            draw_board_client(board);
-            refresh_screen();
             pthread_mutex_lock(&mutex);
             stop_execution = true;
             pthread_cond_broadcast(&cond_var);
@@ -62,11 +139,131 @@ static void *receiver_thread(void *arg) {
         }
     }
 
+    free(cells);
     debug("Returning receiver thread...\n");
     return NULL;
 }
 
+// Pede o viewport que cabe no terminal (outra vez depois de um resize)
+static void update_viewport(void) {
+    int view_w, view_h;
+    terminal_board_size(&view_w, &view_h);
+    debug("Viewport %d x %d\n", view_w, view_h);
+    pacman_set_viewport(client, view_w, view_h);
+}
+
+// O terminal mudou de tamanho: novo viewport, e o ultimo frame e redesenhado
+// inteiro ja, sem esperar pela janela nova do servidor
+static void on_resize(void) {
+    update_viewport();
+    pthread_mutex_lock(&mutex);
+    resized = true;
+    if (board_received) {
+        board_updated = true;
+        pthread_cond_broadcast(&cond_var);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+#define SCRIPT_LEAD_FRAMES 2 // frames de comandos em voo no modo ficheiro
+
+// Comandos do ficheiro, lidos uma so vez: comando e ticks a esperar antes dele
+typedef struct {
+    char *commands;
+    unsigned short *waits;
+    int n, cap;
+} script_t;
+
+static int script_add(script_t *script, char command, int wait) {
+    if (script->n == script->cap) {
+        int cap = script->cap ? script->cap * 2 : 64;
+        char *commands = realloc(script->commands, (size_t)cap);
+        if (!commands) return -1;
+        script->commands = commands;
+        unsigned short *waits = realloc(script->waits, (size_t)cap * sizeof(unsigned short));
+        if (!waits) return -1;
+        script->waits = waits;
+        script->cap = cap;
+    }
+    script->commands[script->n] = command;
+    script->waits[script->n] = (unsigned short)(wait < USHRT_MAX ? wait : USHRT_MAX);
+    script->n++;
+    return 0;
+}
+
+// "T n" espera n ticks antes do comando seguinte; o resto sao comandos de uma letra
+static int load_script(FILE *fp, script_t *script) {
+    int wait = 0, ch;
+
+    while ((ch = fgetc(fp)) != EOF) {
+        ch = toupper(ch);
+        if (isspace(ch)) continue;
+        if (ch == 'T') {
+            int turns;
+            if (fscanf(fp, "%d", &turns) == 1 && turns > 0) wait += turns;
+            continue;
+        }
+        if (script_add(script, (char)ch, wait) < 0) return -1;
+        wait = 0;
+    }
+    return 0;
+}
+
+// Modo ficheiro: por cada frame recebido seguem ate per_frame comandos num
+// OP_CODE_PLAY_BATCH, sem passar de SCRIPT_LEAD_FRAMES frames de comandos por
+// confirmar; o servidor corre-os nos ticks certos. O script repete-se ate um 'Q'
+static void play_script(const script_t *script, int per_frame) {
+    char commands[MAX_BATCH_PLAYS];
+    unsigned short waits[MAX_BATCH_PLAYS];
+    unsigned long seen = 0;
+    int next = 0, quitting = 0;
+
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        while (!stop_execution && frames_received == seen) {
+            pthread_cond_wait(&cond_var, &mutex);
+        }
+        if (stop_execution) break;
+        seen = frames_received;
+        pthread_mutex_unlock(&mutex);
+
+        // o teclado so e lido para ver se o terminal mudou de tamanho
+        if (get_input() == INPUT_RESIZE) on_resize();
+
+        int unacked = pacman_unacked(client);
+        if (quitting) {
+            // o 'Q' so sai depois de o servidor aplicar tudo o que foi antes
+            if (unacked == 0) {
+                debug("Commands file quits the game\n");
+                pacman_disconnect(client);
+                return;
+            }
+            pthread_mutex_lock(&mutex);
+            continue;
+        }
+
+        int room = SCRIPT_LEAD_FRAMES * per_frame - unacked;
+        if (room > per_frame) room = per_frame;
+        int n = 0;
+        while (n < room && script->n > 0) {
+            if (script->commands[next] == 'Q') {
+                quitting = 1;
+                break;
+            }
+            commands[n] = script->commands[next];
+            waits[n] = script->waits[next];
+            n++;
+            next = (next + 1) % script->n;
+        }
+        if (n > 0 && pacman_play_batch(client, commands, waits, n) < 0) return;
+
+        pthread_mutex_lock(&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
 int main(int argc, char *argv[]) {
+    signal(SIGPIPE, SIG_IGN); // o servidor pode fechar o pipe a meio de um envio
     if (argc != 3 && argc != 4) {
         fprintf(stderr,
             "Usage: %s <client_id> <register_pipe> [commands_file]\n",
@@ -78,13 +275,19 @@ int main(int argc, char *argv[]) {
     const char *register_pipe = argv[2];
     const char *commands_file = (argc == 4) ? argv[3] : NULL;
 
-    FILE *cmd_fp = NULL;
+    script_t script = {0};
     if (commands_file) {
-        cmd_fp = fopen(commands_file, "r");
+        FILE *cmd_fp = fopen(commands_file, "r");
         if (!cmd_fp) {
             perror("Failed to open commands file");
             return 1;
         }
+        int loaded = load_script(cmd_fp, &script);
+        fclose(cmd_fp);
+        if (loaded < 0) {
+            perror("Failed to read commands file");
+            return 1;
+        }
     }
 
     char req_pipe_path[MAX_PIPE_PATH_LENGTH];
@@ -98,30 +301,32 @@ int main(int argc, char *argv[]) {
 
     open_debug_file("client-debug.log");
 
-    if (pacman_connect(req_pipe_path, notif_pipe_path, register_pipe) != 0) {
+    client = pacman_connect(req_pipe_path, notif_pipe_path, register_pipe);
+    if (!client) {
         perror("Failed to connect to server");
         return 1;
     }
 
-    pthread_t receiver_thread_id;
-    pthread_create(&receiver_thread_id, NULL, receiver_thread, NULL);
-
     terminal_init();
-    set_timeout(500);
+    // no modo ficheiro o teclado e lido sem esperar, uma vez por frame
+    set_timeout(commands_file ? 0 : 500);
+
+    // so vale a pena receber o que cabe no ecra
+    update_viewport();
+
+    pthread_t receiver_thread_id, render_thread_id;
+    pthread_create(&receiver_thread_id, NULL, receiver_thread, NULL);
+    pthread_create(&render_thread_id, NULL, render_thread, NULL);
 
     pthread_mutex_lock(&mutex);
-    while (!board_updated && !stop_execution) {
+    while (!board_received && !stop_execution) {
         pthread_cond_wait(&cond_var, &mutex);
     }
     pthread_mutex_unlock(&mutex);
 
-    draw_board_client(board);
-    refresh_screen();
-
     char command;
-    int ch;
 
-    while (1) {
+    while (!commands_file) {
 
         pthread_mutex_lock(&mutex);
         if (stop_execution){
@@ -131,78 +336,60 @@ int main(int argc, char *argv[]) {
         }
         pthread_mutex_unlock(&mutex);
 
-        if (cmd_fp) {
-            // Input from file
-            ch = fgetc(cmd_fp);
-
-            if (ch == EOF) {
-                // Restart at the start of the file
-                rewind(cmd_fp);
-                continue;
-            }
-
-            command = (char)ch;
-
-            if (command == '\n' || command == '\r' || command == '\0' || command == ' ' || command == '\t')
-                continue;
-
-            command = toupper(command);
-            
-            // Wait for tempo, to not overflow pipe with requests
-            pthread_mutex_lock(&mutex);
-            int wait_for = tempo;
-            int should_stop = stop_execution;
-            pthread_mutex_unlock(&mutex);
-
-            if (should_stop) break;
-
-            //sleep_ms(wait_for);
-
-            int slept = 0;
-            while (slept < wait_for) {
-                pthread_mutex_lock(&mutex);
-                bool stop = stop_execution;
-                pthread_mutex_unlock(&mutex);
-                if (stop) break;
-
-                int chunk = 10;
-                if (wait_for - slept < chunk) chunk = wait_for - slept;
-                sleep_ms(chunk);
-                slept += chunk;
-            }
-
-            pthread_mutex_lock(&mutex);
-            should_stop = stop_execution;
-            pthread_mutex_unlock(&mutex);
-            if (should_stop) break;
-            
-        } else {
-            // Interactive input
-            command = get_input();
-            command = toupper(command);
-        }
+        // Interactive input
+        command = get_input();
+        command = toupper(command);
 
         if (command == '\0')
             continue;
 
+        if (command == INPUT_RESIZE) {
+            on_resize();
+            continue;
+        }
+
         if (command == 'Q') {
             debug("Client pressed 'Q', quitting game\n");
-            pacman_disconnect();
+            pacman_disconnect(client);
             break;
         }
 
         debug("Command: %c\n", command);
 
-        pacman_play(command);
+        pacman_play(client, command);
+
+        // mostra ja a jogada prevista, sem esperar pelo proximo frame do servidor.
+        // Prever com o mutex: um frame do servidor guardado depois e sempre mais recente.
+        // A previsao e escrita direto no board global
+        pthread_mutex_lock(&mutex);
+        Board predicted;
+        if (!stop_execution && pacman_predict(client, &predicted, board.data, board_cap) == 1) {
+            board = predicted;
+            board_updated = true;
+            pthread_cond_broadcast(&cond_var);
+        }
+        pthread_mutex_unlock(&mutex);
+
+    }
 
+    if (commands_file) {
+        // PACMAN_CMDS_PER_FRAME: comandos enviados por frame recebido (1 por omissao)
+        const char *ratio = getenv("PACMAN_CMDS_PER_FRAME");
+        int per_frame = ratio ? atoi(ratio) : 1;
+        if (per_frame < 1) per_frame = 1;
+        if (per_frame > MAX_BATCH_PLAYS / SCRIPT_LEAD_FRAMES) per_frame = MAX_BATCH_PLAYS / SCRIPT_LEAD_FRAMES;
+        // o servidor fecha a sessao se a fila do script transbordar
+        if (per_frame > SCRIPT_QUEUE_SIZE / SCRIPT_LEAD_FRAMES) per_frame = SCRIPT_QUEUE_SIZE / SCRIPT_LEAD_FRAMES;
+        play_script(&script, per_frame);
+        free(script.commands);
+        free(script.waits);
     }
 
     debug("Game ended, waiting before cleanup...\n");
     
     pthread_join(receiver_thread_id, NULL);
-
-    draw_board_client(board);
-    refresh_screen();
+    // a render thread desenha o último frame antes de sair
+    pthread_join(render_thread_id, NULL);
 
     // Dar tempo ao jogador para ver a mensagem de vitória/derrota
     debug("Showing final message for %d milliseconds...\n", board.tempo);
@@ -210,17 +397,14 @@ int main(int argc, char *argv[]) {
 
     terminal_cleanup();
 
-    pacman_disconnect();
-
-    draw_board_client(board);
+    pacman_close(client);
 
     pthread_mutex_lock(&mutex);
-    if (board.data) free(board.data);
+    free(board.data);
     board.data = NULL;
+    board_cap = 0;
     pthread_mutex_unlock(&mutex);
 
-    if (cmd_fp)
-        fclose(cmd_fp);
 
     pthread_mutex_destroy(&mutex);
 
@@ -4,6 +4,7 @@
 #include "debug.h"
 #include <stdlib.h>
 #include <ctype.h>
+#include <string.h>
 
 /**void* ncurses_thread(void *arg) {
     board_t *board = (board_t*) arg;
@@ -57,150 +58,124 @@ int terminal_init() {
 
     // Clear the screen
     clear();
+    display_invalidate();
 
     return 0;
 }
 
 
-void draw_board_client(Board board) {
-    // Clear the screen before redrawing
-    clear();
-
-    // Draw the border/title
-    attron(COLOR_PAIR(5));
-    mvprintw(0, 0, "=== PACMAN GAME ===");
-    if (board.game_over) {
-        mvprintw(1, 0, " GAME OVER ");
-    } else if (board.victory == 1) {
-        mvprintw(1, 0, " VICTORY ");
-    } else {
-        mvprintw(1, 0, " Use W/A/S/D to move | Q to quit");
+// Last frame drawn: the next one only redraws the cells that changed
+static char *drawn = NULL;
+static chtype *run = NULL; // cells of one changed run, with their attributes
+static size_t drawn_cap = 0;
+static int drawn_w = -1, drawn_h = -1;
+static int drawn_status = -1, drawn_points = -1;
+
+static chtype cell_chtype(char ch) {
+    switch (ch) {
+        case '#': return '#' | COLOR_PAIR(3); // Wall
+        case 'C': return 'C' | COLOR_PAIR(1) | A_BOLD; // Pacman
+        case 'M': return 'M' | COLOR_PAIR(2) | A_BOLD; // Monster/Ghost
+        case 'G': return 'M' | COLOR_PAIR(2) | A_BOLD | A_DIM; // Charged Monster/Ghost
+        case '.': return '.' | COLOR_PAIR(4); // Dot
+        case '@': return '@' | COLOR_PAIR(6); // Portal
+        default: return (chtype)(unsigned char)ch;
     }
+}
 
+void display_invalidate(void) {
+    drawn_w = drawn_h = -1;
+}
+
+void draw_board_client(Board board) {
     // Starting row for the game board (leave space for UI)
     int start_row = 3;
+    size_t n = (size_t)(board.width * board.height);
+    int full = board.width != drawn_w || board.height != drawn_h;
+
+    if (full) {
+        erase();
+        drawn_status = drawn_points = -1;
+        drawn_w = drawn_h = -1;
+        if (n > drawn_cap || (size_t)board.width > drawn_cap) {
+            size_t cap = n > (size_t)board.width ? n : (size_t)board.width;
+            char *cells = realloc(drawn, cap);
+            if (cells) drawn = cells;
+            chtype *cells_run = realloc(run, cap * sizeof(chtype));
+            if (cells_run) run = cells_run;
+            if (!cells || !cells_run) return;
+            drawn_cap = cap;
+        }
+    }
 
-    // Draw the board
-    for (int y = 0; y < board.height; y++) {
-        for (int x = 0; x < board.width; x++) {
-            char ch = board.data[y * board.width + x];
-
-            // Move cursor to position
-            move(start_row + y, x);
-
-            // Draw with appropriate color
-            switch (ch) {
-                case '#': // Wall
-                    attron(COLOR_PAIR(3));
-                    addch('#');
-                    attroff(COLOR_PAIR(3));
-                    break;
-
-                case 'C': // Pacman
-                    attron(COLOR_PAIR(1) | A_BOLD);
-                    addch('C');
-                    attroff(COLOR_PAIR(1) | A_BOLD);
-                    break;
-
-                case 'M': // Monster/Ghost
-                    attron(COLOR_PAIR(2) | A_BOLD);
-                    addch('M');
-                    attroff(COLOR_PAIR(2) | A_BOLD);  
-                    break;
-
-                case 'G': // Charged Monster/Ghost
-                    attron((COLOR_PAIR(2) | A_BOLD) | A_DIM);
-                    addch('M');
-                    attroff((COLOR_PAIR(2) | A_BOLD) | A_DIM);  
-                    break;
-
-                case '.': // Dot
-                    attron(COLOR_PAIR(4));
-                    addch('.');
-                    attroff(COLOR_PAIR(4));
-                    break;
-
-                case '@': // Portal
-                    attron(COLOR_PAIR(6));
-                    addch('@');
-                    attroff(COLOR_PAIR(6));
-                    break;
-
-                case ' ': // Empty space
-                    addch(' ');
-                    break;
+    // Draw the border/title
+    int status = board.game_over ? 1 : board.victory == 1 ? 2 : 0;
+    if (status != drawn_status) {
+        attron(COLOR_PAIR(5));
+        mvprintw(0, 0, "=== PACMAN GAME ===");
+        if (status == 1) {
+            mvprintw(1, 0, " GAME OVER ");
+        } else if (status == 2) {
+            mvprintw(1, 0, " VICTORY ");
+        } else {
+            mvprintw(1, 0, " Use W/A/S/D to move | Q to quit");
+        }
+        clrtoeol();
+        attroff(COLOR_PAIR(5));
+        drawn_status = status;
+    }
 
-                default:
-                    addch(ch);
-                    break;
+    // Draw the board: one call per run of changed cells
+    for (int y = 0; y < board.height; y++) {
+        const char *row = board.data + y * board.width;
+        const char *old = drawn + y * board.width;
+        int x = 0;
+        while (x < board.width) {
+            if (!full && row[x] == old[x]) {
+                x++;
+                continue;
+            }
+            int start = x, len = 0;
+            while (x < board.width && (full || row[x] != old[x])) {
+                run[len++] = cell_chtype(row[x]);
+                x++;
             }
+            mvaddchnstr(start_row + y, start, run, len);
         }
     }
+    memcpy(drawn, board.data, n);
+    drawn_w = board.width;
+    drawn_h = board.height;
 
     // Draw score/status at the bottom
-    attron(COLOR_PAIR(5));
-    mvprintw(start_row + board.height + 1, 0, "Points: %d\n",
-             board.accumulated_points);
-    attroff(COLOR_PAIR(5));
+    if (board.accumulated_points != drawn_points) {
+        attron(COLOR_PAIR(5));
+        mvprintw(start_row + board.height + 1, 0, "Points: %d", board.accumulated_points);
+        clrtoeol();
+        attroff(COLOR_PAIR(5));
+        drawn_points = board.accumulated_points;
+    }
 }
 
 // Does exaclty the same as draw board but stores the output in a string instead of printing it
 char* get_board_displayed(board_t* board) {
-    size_t buffer_size = (board->width  * board->height) + 1;
-    char* output = malloc(buffer_size);
-    size_t pos = 0;
+    size_t n = (size_t)(board->width * board->height);
+    char* output = malloc(n + 1);
+    if (!output) return NULL;
     for (int y = 0; y < board->height; y++) {
         for (int x = 0; x < board->width; x++) {
-            int index = y * board->width + x;
-            char ch = board->board[index].content;
-            int ghost_charged = 0;
-
-            for (int g = 0; g < board->n_ghosts; g++) {
-                ghost_t* ghost = &board->ghosts[g];
-                if (ghost->pos_x == x && ghost->pos_y == y) {
-                    if (ghost->charged)
-                        ghost_charged = 1;
-                    break;
-                }
-            }
-
-            // Draw with appropriate character
-            switch (ch) {
-                case 'W': // Wall
-                    output[pos++] = '#';
-                    break;
-
-                case 'P': // Pacman
-                    output[pos++] = 'C';
-                    break;
-
-                case 'M': // Monster/Ghost
-                    if (ghost_charged) {
-                        output[pos++] = 'G'; 
-                    } else {
-                        output[pos++] = 'M';
-                    }
-                    break;
-
-                case ' ': // Empty space
-                    if (board->board[index].has_portal) {
-                        output[pos++] = '@';
-                    }
-                    else if (board->board[index].has_dot) {
-                        output[pos++] = '.';
-                    }
-                    else
-                        output[pos++] = ' ';
-                    break;
-
-                default:
-                    output[pos++] = ch;
-                    break;
-            }
+            output[y * board->width + x] = cell_display(*board_cell(board, x, y));
         }
     }
-    
-    output[pos] = '\0';
+
+    // charged ghosts: the lowest index on a cell decides, so walk them backwards
+    for (int g = board->n_ghosts - 1; g >= 0; g--) {
+        ghost_t* ghost = &board->ghosts[g];
+        char* ch = &output[ghost->pos_y * board->width + ghost->pos_x];
+        if (*ch == 'M' || *ch == 'G') *ch = ghost->charged ? 'G' : 'M';
+    }
+
+    output[n] = '\0';
     return output;
 }
 
@@ -232,8 +207,7 @@ void draw_board(board_t* board, int mode) {
     // Draw the board
     for (int y = 0; y < board->height; y++) {
         for (int x = 0; x < board->width; x++) {
-            int index = y * board->width + x;
-            char ch = board->board[index].content;
+            char ch = cell_display(*board_cell(board, x, y));
             int ghost_charged = 0;
 
             for (int g = 0; g < board->n_ghosts; g++) {
@@ -250,13 +224,13 @@ void draw_board(board_t* board, int mode) {
 
             // Draw with appropriate color
             switch (ch) {
-                case 'W': // Wall
+                case '#': // Wall
                     attron(COLOR_PAIR(3));
                     addch('#');
                     attroff(COLOR_PAIR(3));
                     break;
 
-                case 'P': // Pacman
+                case 'C': // Pacman
                     attron(COLOR_PAIR(1) | A_BOLD);
                     addch('C');
                     attroff(COLOR_PAIR(1) | A_BOLD);
@@ -268,19 +242,16 @@ void draw_board(board_t* board, int mode) {
                     attroff((COLOR_PAIR(2) | A_BOLD) | ((ghost_charged) ? (A_DIM) : (0)));
                     break;
 
-                case ' ': // Empty space
-                    if (board->board[index].has_portal) {
-                        attron(COLOR_PAIR(6));
-                        addch('@');
-                        attroff(COLOR_PAIR(6));
-                    }
-                    else if (board->board[index].has_dot) {
-                        attron(COLOR_PAIR(4));
-                        addch('.');
-                        attroff(COLOR_PAIR(4));
-                    }
-                    else
-                        addch(' ');
+                case '@': // Portal
+                    attron(COLOR_PAIR(6));
+                    addch('@');
+                    attroff(COLOR_PAIR(6));
+                    break;
+
+                case '.': // Dot
+                    attron(COLOR_PAIR(4));
+                    addch('.');
+                    attroff(COLOR_PAIR(4));
                     break;
 
                 default:
@@ -317,6 +288,9 @@ char get_input() {
     if (ch == ERR) {
         return '\0'; // No input
     }
+    if (ch == KEY_RESIZE) {
+        return INPUT_RESIZE; // LINES and COLS already hold the new size
+    }
 
     ch = toupper((char)ch);
 
@@ -340,6 +314,12 @@ void terminal_cleanup() {
     endwin();
 }
 
+void terminal_board_size(int *width, int *height) {
+    // draw_board_client uses 3 rows above the board and 2 below it
+    *width = COLS > 0 ? COLS : 1;
+    *height = LINES > 5 ? LINES - 5 : 1;
+}
+
 void set_timeout(int timeout_ms) {
     timeout(timeout_ms);
 }
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "codec.h"
+
+#define RLE_MAX_RUN 256
+
+// display chars in nibble order; 0 is the most common (empty) cell
+static const char pack4_chars[] = {' ', '#', '.', 'C', 'M', '@', 'G'};
+#define PACK4_SYMBOLS ((int)sizeof(pack4_chars))
+
+static int pack4_nibble(char c) {
+  for (int i = 0; i < PACK4_SYMBOLS; i++) {
+    if (pack4_chars[i] == c) return i;
+  }
+  return -1;
+}
+
+// Length of the run of cells equal to p[0], at most max. Compares 8 cells per step
+static size_t run_length(const char *p, size_t max) {
+  uint64_t pattern = 0x0101010101010101ULL * (unsigned char)p[0];
+  size_t i = 0;
+
+  while (i + 8 <= max) {
+    uint64_t word;
+    memcpy(&word, p + i, 8);
+    uint64_t diff = word ^ pattern;
+    if (diff) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      return i + (size_t)(__builtin_ctzll(diff) / 8);
+#else
+      return i + (size_t)(__builtin_clzll(diff) / 8);
+#endif
+    }
+    i += 8;
+  }
+  while (i < max && p[i] == p[0]) i++;
+  return i;
+}
+
+static int rle_encode(const char *cells, size_t n, unsigned char *out, size_t max) {
+  size_t off = 0;
+
+  for (size_t i = 0; i < n; ) {
+    size_t left = n - i;
+    size_t run = run_length(cells + i, left < RLE_MAX_RUN ? left : RLE_MAX_RUN);
+    if (off + 2 > max) return -1;
+    out[off++] = (unsigned char)(run - 1);
+    out[off++] = (unsigned char)cells[i];
+    i += run;
+  }
+  return (int)off;
+}
+
+static int rle_decode(const unsigned char *in, size_t len, char *cells, size_t n) {
+  size_t pos = 0;
+
+  if (len % 2) return -1;
+  for (size_t off = 0; off < len; off += 2) {
+    size_t run = (size_t)in[off] + 1;
+    if (run > n - pos) return -1;
+    memset(cells + pos, in[off + 1], run);
+    pos += run;
+  }
+  return pos == n ? 0 : -1;
+}
+
+static int pack4_encode(const char *cells, size_t n, unsigned char *out, size_t max) {
+  size_t len = (n + 1) / 2;
+  if (len > max) return -1;
+
+  for (size_t i = 0; i < n; i += 2) {
+    int lo = pack4_nibble(cells[i]);
+    int hi = i + 1 < n ? pack4_nibble(cells[i + 1]) : 0;
+    if (lo < 0 || hi < 0) return -1;
+    out[i / 2] = (unsigned char)(lo | hi << 4);
+  }
+  return (int)len;
+}
+
+static int pack4_decode(const unsigned char *in, size_t len, char *cells, size_t n) {
+  if (len != (n + 1) / 2) return -1;
+
+  for (size_t i = 0; i < n; i++) {
+    int nibble = (in[i / 2] >> (i % 2 ? 4 : 0)) & 0x0f;
+    if (nibble >= PACK4_SYMBOLS) return -1;
+    cells[i] = pack4_chars[nibble];
+  }
+  return 0;
+}
+
+int codec_encode(int codec, const char *cells, size_t n, unsigned char *out, size_t max) {
+  switch (codec) {
+    case CODEC_RAW:
+      if (n > max) return -1;
+      memcpy(out, cells, n);
+      return (int)n;
+    case CODEC_RLE:
+      return rle_encode(cells, n, out, max);
+    case CODEC_PACK4:
+      return pack4_encode(cells, n, out, max);
+  }
+  return -1;
+}
+
+int codec_decode(int codec, const unsigned char *in, size_t len, char *cells, size_t n) {
+  switch (codec) {
+    case CODEC_RAW:
+      if (len != n) return -1;
+      memcpy(cells, in, n);
+      return 0;
+    case CODEC_RLE:
+      return rle_decode(in, len, cells, n);
+    case CODEC_PACK4:
+      return pack4_decode(in, len, cells, n);
+  }
+  return -1;
+}
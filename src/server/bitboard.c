@@ -0,0 +1,70 @@
+#include "bitboard.h"
+
+#include <stdlib.h>
+
+int plane_init(bitplane_t *plane, int width, int height) {
+    plane->width = width;
+    plane->height = height;
+    plane->row_words = (width + 63) / 64;
+    plane->col_words = (height + 63) / 64;
+    plane->rows = calloc((size_t)height * plane->row_words, sizeof(uint64_t));
+    plane->cols = calloc((size_t)width * plane->col_words, sizeof(uint64_t));
+    if (!plane->rows || !plane->cols) {
+        plane_free(plane);
+        return -1;
+    }
+    return 0;
+}
+
+void plane_free(bitplane_t *plane) {
+    free(plane->rows);
+    free(plane->cols);
+    plane->rows = NULL;
+    plane->cols = NULL;
+}
+
+int plane_count(const bitplane_t *plane) {
+    size_t n = (size_t)plane->height * plane->row_words;
+    int count = 0;
+    for (size_t i = 0; i < n; i++) count += __builtin_popcountll(plane->rows[i]);
+    return count;
+}
+
+// First set bit of a line of n bits strictly after from, going dir, at most span bits away; -1 if none
+static int scan_line(const uint64_t *words, int n, int from, int dir, int span) {
+    if (dir > 0) {
+        int i = from + 1;
+        if (span < n - from - 1) n = from + span + 1;
+        if (i >= n) return -1;
+        int w = i >> 6;
+        uint64_t word = words[w] & (~0ULL << (i & 63));
+        int last = (n - 1) >> 6;
+        while (!word) {
+            if (++w > last) return -1;
+            word = words[w];
+        }
+        int bit = (w << 6) + __builtin_ctzll(word);
+        return bit < n ? bit : -1;
+    }
+
+    int i = from - 1;
+    int low = from - span > 0 ? from - span : 0;
+    if (i < low) return -1;
+    int w = i >> 6;
+    // bits 0..(i & 63) of word w
+    uint64_t word = words[w] & (~0ULL >> (63 - (i & 63)));
+    while (!word) {
+        if (--w < (low >> 6)) return -1;
+        word = words[w];
+    }
+    int bit = (w << 6) + 63 - __builtin_clzll(word);
+    return bit >= low ? bit : -1;
+}
+
+int plane_scan_row(const bitplane_t *plane, int y, int x, int dx, int span) {
+    return scan_line(&plane->rows[y * plane->row_words], plane->width, x, dx, span);
+}
+
+int plane_scan_col(const bitplane_t *plane, int x, int y, int dy, int span) {
+    return scan_line(&plane->cols[x * plane->col_words], plane->height, y, dy, span);
+}
@@ -3,33 +3,104 @@
 #include "debug.h"
 #include <stdlib.h>
 #include <stdio.h> //snprintf
+#include <string.h>
 #include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <pthread.h>
 
-// Helper private function to find and kill pacman at specific position
-static int find_and_kill_pacman(board_t* board, int new_x, int new_y) {
-    for (int p = 0; p < board->n_pacmans; p++) {
-        pacman_t* pac = &board->pacmans[p];
-        if (pac->pos_x == new_x && pac->pos_y == new_y && pac->alive) {
-            pac->alive = 0;
-            kill_pacman(board, p);
-            return DEAD_PACMAN;
+// Records a cell change for the frame sender
+static void touch_cell(board_t* board) {
+    board->version++;
+}
+
+// Helper private function: cells from (x, y) to the first set cell of a plane
+// in direction (dx, dy), looking at most span cells away; span + 1 if there is none
+static int plane_distance(board_t* board, int plane, int x, int y, int dx, int dy, int span) {
+    const bitplane_t* p = &board->planes[plane];
+    if (dx) {
+        int hit = plane_scan_row(p, y, x, dx, span);
+        return hit < 0 ? span + 1 : (hit - x) * dx;
+    }
+    int hit = plane_scan_col(p, x, y, dy, span);
+    return hit < 0 ? span + 1 : (hit - y) * dy;
+}
+
+// Helper private functions for the occupancy index: entities are hashed by
+// cell into occ_mask + 1 buckets, chained through occ_next, newest first
+static int* occ_bucket(board_t* board, int x, int y) {
+    unsigned h = (unsigned)x * 0x9e3779b1u ^ (unsigned)y * 0x85ebca6bu;
+    return &board->occ_head[(h ^ h >> 16) & board->occ_mask];
+}
+
+static void occ_add(board_t* board, int id, int x, int y) {
+    int* head = occ_bucket(board, x, y);
+    board->occ_next[id] = *head;
+    *head = id;
+}
+
+static void occ_remove(board_t* board, int id, int x, int y) {
+    int* link = occ_bucket(board, x, y);
+    while (*link != ENTITY_NONE) {
+        if (*link == id) {
+            *link = board->occ_next[id];
+            board->occ_next[id] = ENTITY_NONE;
+            return;
         }
+        link = &board->occ_next[*link];
     }
-    return VALID_MOVE;
 }
 
-// Helper private function for getting board position index
-static inline int get_board_index(board_t* board, int x, int y) {
-    return y * board->width + x;
+// Whether entity id stands on (x, y); bucket mates may be elsewhere
+static int occ_at(board_t* board, int id, int x, int y) {
+    if (id < board->n_pacmans) {
+        pacman_t* pac = &board->pacmans[id];
+        return pac->pos_x == x && pac->pos_y == y;
+    }
+    ghost_t* ghost = &board->ghosts[id - board->n_pacmans];
+    return ghost->pos_x == x && ghost->pos_y == y;
+}
+
+// Steps from (x, y) to the nearest wall in direction dir (dx, dy). Uses the jump
+// table when the board has one, else scans the wall plane up to the border
+static int wall_distance(board_t* board, int dir, int x, int y, int dx, int dy) {
+    if (board->wall_dist[dir]) return board->wall_dist[dir][y * board->width + x];
+
+    int edge = dx > 0 ? board->width - x : dx < 0 ? x + 1 : dy > 0 ? board->height - y : y + 1;
+    return plane_distance(board, PLANE_WALL, x, y, dx, dy, edge - 1);
+}
+
+// Helper private functions moving an entity on the grid, the planes and the occupancy index
+static void relocate_pacman(board_t* board, int pacman_index, int x, int y) {
+    pacman_t* pac = &board->pacmans[pacman_index];
+    occ_remove(board, pacman_index, pac->pos_x, pac->pos_y);
+    board_set_content(board, pac->pos_x, pac->pos_y, 0);
+    pac->pos_x = x;
+    pac->pos_y = y;
+    board_set_content(board, x, y, CELL_PACMAN);
+    occ_add(board, pacman_index, x, y);
 }
 
-// Helper private function for checking valid position
-static inline int is_valid_position(board_t* board, int x, int y) {
-    return (x >= 0 && x < board->width) && (y >= 0 && y < board->height); // Inside of the board boundaries
+static void relocate_ghost(board_t* board, int ghost_index, int x, int y) {
+    ghost_t* ghost = &board->ghosts[ghost_index];
+    int id = board_ghost_id(board, ghost_index);
+    occ_remove(board, id, ghost->pos_x, ghost->pos_y);
+    board_set_content(board, ghost->pos_x, ghost->pos_y, 0); // Or restore the dot if ghost was on one
+    ghost->pos_x = x;
+    ghost->pos_y = y;
+    board_set_content(board, x, y, CELL_GHOST);
+    occ_add(board, id, x, y);
+}
+
+// Helper private function to find and kill pacman at specific position
+static int find_and_kill_pacman(board_t* board, int new_x, int new_y) {
+    int p = board_pacman_at(board, new_x, new_y);
+    if (p < 0) return VALID_MOVE;
+
+    board->pacmans[p].alive = 0;
+    kill_pacman(board, p);
+    return DEAD_PACMAN;
 }
 
 int move_pacman(board_t* board, int pacman_index, command_t* command) {
@@ -83,216 +154,92 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
     // Logic for the WASD movement
     pac->current_move+=1;
 
-    // Check boundaries
-    if (!is_valid_position(board, new_x, new_y)) {
-        return INVALID_MOVE;
-    }
-
-    int new_index = get_board_index(board, new_x, new_y);
-    int old_index = get_board_index(board, pac->pos_x, pac->pos_y);
-
-    // locks
-    if (old_index < new_index) {
-        pthread_mutex_lock(&board->board[old_index].lock);
-        pthread_mutex_lock(&board->board[new_index].lock);
-    }
-    else {
-        pthread_mutex_lock(&board->board[new_index].lock);
-        pthread_mutex_lock(&board->board[old_index].lock);
-    }
-
-    char target_content = board->board[new_index].content;
+    // the sentinel border makes leaving the board a wall hit
+    cell_t* new_cell = board_cell(board, new_x, new_y);
 
-    if (board->board[new_index].has_portal) {
-        board->board[old_index].content = ' ';
-        board->board[new_index].content = 'P';
+    if (*new_cell & CELL_PORTAL) {
+        relocate_pacman(board, pacman_index, new_x, new_y);
         return REACHED_PORTAL;
     }
 
     // Check for walls
-    if (target_content == 'W') {
-        goto move_pacman_invalid;
+    if (*new_cell & CELL_WALL) {
+        return INVALID_MOVE;
     }
 
     // Check for ghosts
-    if (target_content == 'M') {
+    if (*new_cell & CELL_GHOST) {
+        debug("Pacman %d ran into ghost %d\n", pacman_index, board_ghost_at(board, new_x, new_y));
         kill_pacman(board, pacman_index);
-        goto move_pacman_dead;
+        return DEAD_PACMAN;
     }
 
     // Collect points
-    if (board->board[new_index].has_dot) {
+    if (*new_cell & CELL_DOT) {
         pac->points++;
-        board->board[new_index].has_dot = 0;
+        *new_cell &= (cell_t)~CELL_DOT;
+        plane_clear(&board->planes[PLANE_DOT], new_x, new_y);
+        int dot = board_dot_index(board, new_x, new_y);
+        board->eaten[dot >> 3] |= (unsigned char)(1u << (dot & 7));
+        touch_cell(board);
     }
 
-    board->board[old_index].content = ' ';
-    pac->pos_x = new_x;
-    pac->pos_y = new_y;
-    board->board[new_index].content = 'P';
+    relocate_pacman(board, pacman_index, new_x, new_y);
 
-    if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
-    }
-    else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
-    }
-    
     return VALID_MOVE;
-
-    move_pacman_invalid:
-    if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
-    }
-    else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
-    }
-    return INVALID_MOVE;
-
-    move_pacman_dead:
-    if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
-    }
-    else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
-    }
-    return DEAD_PACMAN;
 }
 
 int move_ghost_charged(board_t* board, int ghost_index, char direction) {
     ghost_t* ghost = &board->ghosts[ghost_index];
     int x = ghost->pos_x;
     int y = ghost->pos_y;
-    int new_x = x;
-    int new_y = y;
-    int result = 0;
+    int dx = 0, dy = 0, dir;
+    int result = VALID_MOVE;
 
     ghost->charged = 0; //uncharge
 
     switch (direction) {
         case 'W':
             if (y == 0) return INVALID_MOVE;
-
-            for (int i = 0; i <= y; i++) {
-                pthread_mutex_lock(&board->board[i * board->width + x].lock);
-            }
-
-            new_y = 0; // In case there is no colision
-            for (int i = y - 1; i >= 0; i--) {
-                char target_content = board->board[i * board->width + x].content;
-                if (target_content == 'W' || target_content == 'M') {
-                    new_y = i + 1; // stop before colision
-                    result = VALID_MOVE;
-                    break;
-                }
-                else if (target_content == 'P') {
-                    new_y = i;
-                    result = find_and_kill_pacman(board, new_x, new_y);
-                    break;
-                }
-            }
-
-            for (int i = 0; i <= y; i++) {
-                pthread_mutex_unlock(&board->board[i * board->width + x].lock);
-            }
+            dy = -1;
+            dir = DIR_UP;
             break;
         case 'S':
             if (y == board->height - 1) return INVALID_MOVE;
-
-            for (int i = y; i < board->height; i++) {
-                pthread_mutex_lock(&board->board[i * board->width + x].lock);
-            }
-
-            new_y = board->height - 1; // In case there is no colision
-            for (int i = y + 1; i < board->height; i++) {
-                char target_content = board->board[i * board->width + x].content;
-                if (target_content == 'W' || target_content == 'M') {
-                    new_y = i - 1; // stop before colision
-                    result = VALID_MOVE;
-                    break;
-                }
-                else if (target_content == 'P') {
-                    new_y = i;
-                    result = find_and_kill_pacman(board, new_x, new_y);
-                    break;
-                }
-            }
-
-            for (int i = y; i < board->height; i++) {
-                pthread_mutex_unlock(&board->board[i * board->width + x].lock);
-            }
+            dy = 1;
+            dir = DIR_DOWN;
             break;
         case 'A':
             if (x == 0) return INVALID_MOVE;
-
-            for (int j = 0; j <= x; j++) {
-                pthread_mutex_lock(&board->board[y * board->width + j].lock);
-            }
-
-            new_x = 0; // In case there is no colision
-            for (int j = x - 1; j >= 0; j--) {
-                char target_content = board->board[y * board->width + j].content;
-                if (target_content == 'W' || target_content == 'M') {
-                    new_x = j + 1; // stop before colision
-                    result = VALID_MOVE;
-                    break;
-                }
-                else if (target_content == 'P') {
-                    new_x = j;
-                    result = find_and_kill_pacman(board, new_x, new_y);
-                    break;
-                }
-            }
-
-            for (int j = 0; j <= x; j++) {
-                pthread_mutex_unlock(&board->board[y * board->width + j].lock);
-            }
+            dx = -1;
+            dir = DIR_LEFT;
             break;
         case 'D':
             if (x == board->width - 1) return INVALID_MOVE;
-
-            for (int j = x; j < board->width; j++) {
-                pthread_mutex_lock(&board->board[y * board->width + j].lock);
-            }
-
-            new_x = board->width - 1; // In case there is no colision
-            for (int j = x + 1; j < board->width; j++) {
-                char target_content = board->board[y * board->width + j].content;
-                if (target_content == 'W' || target_content == 'M') {
-                    new_x = j - 1; // stop before colision
-                    result = VALID_MOVE;
-                    break;
-                }
-                else if (target_content == 'P') {
-                    new_x = j;
-                    result = find_and_kill_pacman(board, new_x, new_y);
-                    break;
-                }
-            }
-
-            for (int j = x; j < board->width; j++) {
-                pthread_mutex_unlock(&board->board[y * board->width + j].lock);
-            }
+            dx = 1;
+            dir = DIR_RIGHT;
             break;
         default:
             debug("DEFAULT CHARGED MOVE - direction = %c\n", direction);
             return INVALID_MOVE;
     }
 
-    board->board[y * board->width + x].content = ' '; // Or restore the dot if ghost was on one
+    // Slide until a wall or ghost (stop before it) or a pacman (take its cell).
+    // The wall comes from the level's jump table (or the wall plane); ghosts and pacmen are
+    // only looked up in the plane words between the ghost and that wall.
+    int blocked = wall_distance(board, dir, x, y, dx, dy);
+    int ghost_hit = plane_distance(board, PLANE_GHOST, x, y, dx, dy, blocked - 1);
+    if (ghost_hit < blocked) blocked = ghost_hit;
 
-    // Update ghost position
-    ghost->pos_x = new_x;
-    ghost->pos_y = new_y;
+    int dist = blocked - 1;
+    int prey = plane_distance(board, PLANE_PACMAN, x, y, dx, dy, dist);
+    if (prey <= dist) {
+        dist = prey;
+        result = find_and_kill_pacman(board, x + dist * dx, y + dist * dy);
+    }
 
-    // Update board - set new position
-    board->board[new_y * board->width + new_x].content = 'M';
+    // Update ghost position
+    relocate_ghost(board, ghost_index, x + dist * dx, y + dist * dy);
     return result;
 }
 
@@ -349,89 +296,33 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
     if (ghost->charged)
         return move_ghost_charged(board, ghost_index, direction);
 
-    // Check boundaries
-    if (!is_valid_position(board, new_x, new_y)) {
-        return INVALID_MOVE;
-    }
-
-    // Check board position
-    int new_index = new_y * board->width + new_x;
-    int old_index = ghost->pos_y * board->width + ghost->pos_x;
-
-    // locks
-    if (old_index < new_index) {
-        pthread_mutex_lock(&board->board[old_index].lock);
-        pthread_mutex_lock(&board->board[new_index].lock);
-    }
-    else {
-        pthread_mutex_lock(&board->board[new_index].lock);
-        pthread_mutex_lock(&board->board[old_index].lock);
-    }
-
-    char target_content = board->board[new_index].content;
-
-    // Check for walls
-    if (target_content == 'W') {
-        goto move_ghost_invalid;
-    }
+    // Check board position (the sentinel border makes leaving the board a wall hit)
+    cell_t* new_cell = board_cell(board, new_x, new_y);
 
-    // Check for ghosts
-    if (target_content == 'M') {
-        goto move_ghost_invalid;
+    // Check for walls and ghosts
+    if (*new_cell & (CELL_WALL | CELL_GHOST)) {
+        return INVALID_MOVE;
     }
 
     int result = VALID_MOVE;
-    // Check for pacman
-    if (target_content == 'P') {
-        for (int i = 0; i < board->n_pacmans; i++) {
-            pacman_t* pac = &board->pacmans[i];
-            if (pac->pos_x == new_x && pac->pos_y == new_y && pac->alive) {
-                pac->alive = 0; // Pacman dies
-                kill_pacman(board, i);
-                result = DEAD_PACMAN;
-                break;
-            }
-        }
+    // Check for pacman (Pacman dies)
+    if (*new_cell & CELL_PACMAN) {
+        result = find_and_kill_pacman(board, new_x, new_y);
     }
 
-    // Update board - clear old position (restore what was there)
-    board->board[old_index].content = ' '; // Or restore the dot if ghost was on one
     // Update ghost position
-    ghost->pos_x = new_x;
-    ghost->pos_y = new_y;
-    // Update board - set new position
-    board->board[new_index].content = 'M';
+    relocate_ghost(board, ghost_index, new_x, new_y);
 
-    if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
-    }
-    else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
-    }
-    
     return result;
-
-    move_ghost_invalid:
-    if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
-    }
-    else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
-    }
-    return INVALID_MOVE;
 }
 
 void kill_pacman(board_t* board, int pacman_index) {
     debug("Killing %d pacman\n\n", pacman_index);
     pacman_t* pac = &board->pacmans[pacman_index];
-    int index = pac->pos_y * board->width + pac->pos_x;
 
     // Remove pacman from the board
-    board->board[index].content = ' ';
+    occ_remove(board, pacman_index, pac->pos_x, pac->pos_y);
+    board_set_content(board, pac->pos_x, pac->pos_y, 0);
 
     // Mark pacman as dead
     pac->alive = 0;
@@ -439,7 +330,7 @@ void kill_pacman(board_t* board, int pacman_index) {
 
 // Static Loading
 int load_pacman(board_t* board) {
-    board->board[1 * board->width + 1].content = 'P'; // Pacman
+    cell_set_content(board_cell(board, 1, 1), CELL_PACMAN); // Pacman
     board->pacmans[0].pos_x = 1;
     board->pacmans[0].pos_y = 1;
     board->pacmans[0].alive = 1;
@@ -449,15 +340,97 @@ int load_pacman(board_t* board) {
 
 // Static Loading
 int load_ghost(board_t* board) {
-    board->board[4 * board->width + 8].content = 'M'; // Monster
+    cell_set_content(board_cell(board, 8, 4), CELL_GHOST); // Monster
     board->ghosts[0].pos_x = 8;
     board->ghosts[0].pos_y = 4;
-    board->board[0 * board->width + 5].content = 'M'; // Monster
+    cell_set_content(board_cell(board, 5, 0), CELL_GHOST); // Monster
     board->ghosts[1].pos_x = 5;
     board->ghosts[1].pos_y = 0;
     return 0;
 }
 
+// Walls never move: one pass per direction gives every cell its distance to the
+// nearest wall (the sentinel border included), so a charge never walks the grid
+static int build_wall_dist(board_t *board) {
+    int w = board->width, h = board->height;
+    if ((long long)w * h > WALL_DIST_MAX_CELLS) return 0; // charges scan the wall plane instead
+
+    for (int d = 0; d < N_DIRS; d++) {
+        board->wall_dist[d] = malloc((size_t)w * h * sizeof(uint16_t));
+        if (!board->wall_dist[d]) return -1;
+    }
+    uint16_t *up = board->wall_dist[DIR_UP], *down = board->wall_dist[DIR_DOWN];
+    uint16_t *left = board->wall_dist[DIR_LEFT], *right = board->wall_dist[DIR_RIGHT];
+
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            int i = y * w + x;
+            left[i] = (*board_cell(board, x - 1, y) & CELL_WALL) ? 1 : (uint16_t)(left[i - 1] + 1);
+        }
+        for (int x = w - 1; x >= 0; x--) {
+            int i = y * w + x;
+            right[i] = (*board_cell(board, x + 1, y) & CELL_WALL) ? 1 : (uint16_t)(right[i + 1] + 1);
+        }
+    }
+    for (int x = 0; x < w; x++) {
+        for (int y = 0; y < h; y++) {
+            int i = y * w + x;
+            up[i] = (*board_cell(board, x, y - 1) & CELL_WALL) ? 1 : (uint16_t)(up[i - w] + 1);
+        }
+        for (int y = h - 1; y >= 0; y--) {
+            int i = y * w + x;
+            down[i] = (*board_cell(board, x, y + 1) & CELL_WALL) ? 1 : (uint16_t)(down[i + w] + 1);
+        }
+    }
+    return 0;
+}
+
+static int build_occupancy(board_t *board) {
+    int n_entities = board->n_pacmans + board->n_ghosts;
+    unsigned n_buckets = 16;
+    while (n_buckets < 4u * (unsigned)n_entities) n_buckets *= 2;
+
+    board->occ_mask = n_buckets - 1;
+    board->occ_head = malloc(n_buckets * sizeof(int));
+    board->occ_next = malloc((size_t)(n_entities > 0 ? n_entities : 1) * sizeof(int));
+    if (!board->occ_head || !board->occ_next) return -1;
+
+    for (unsigned i = 0; i < n_buckets; i++) board->occ_head[i] = ENTITY_NONE;
+    for (int i = 0; i < board->n_pacmans; i++) {
+        pacman_t *pac = &board->pacmans[i];
+        board->occ_next[i] = ENTITY_NONE;
+        if (pac->alive) occ_add(board, i, pac->pos_x, pac->pos_y);
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_t *ghost = &board->ghosts[i];
+        occ_add(board, board_ghost_id(board, i), ghost->pos_x, ghost->pos_y);
+    }
+    return 0;
+}
+
+// Numbers the starting dots for the eaten bitmap. Nothing is eaten yet, so
+// they are the dot plane as loaded
+static int build_dot_index(board_t *board) {
+    int h = board->height;
+    int words = board->planes[PLANE_DOT].row_words;
+    size_t size = (size_t)h * words * sizeof(uint64_t);
+
+    board->start_dots = malloc(size);
+    board->row_dots = malloc(((size_t)h + 1) * sizeof(int));
+    if (!board->start_dots || !board->row_dots) return -1;
+    memcpy(board->start_dots, board->planes[PLANE_DOT].rows, size);
+
+    board->row_dots[0] = 0;
+    for (int y = 0; y < h; y++) {
+        int count = 0;
+        for (int i = 0; i < words; i++) count += __builtin_popcountll(board->start_dots[(size_t)y * words + i]);
+        board->row_dots[y + 1] = board->row_dots[y] + count;
+    }
+
+    board->eaten = calloc((size_t)board->row_dots[h] / 8 + 1, 1);
+    return board->eaten ? 0 : -1;
+}
+
 int load_level(session_t *sess, char *filename, char* dirname, int points) {
     board_t * board = &sess->board;    
     if (read_level(board, filename, dirname) < 0) {
@@ -467,34 +440,168 @@ int load_level(session_t *sess, char *filename, char* dirname, int points) {
 
     if (read_pacman(board, points) < 0) {
         printf("Failed to load the pacman\n");
+        return -1;
     }
 
     if (read_ghosts(board) < 0) {
         printf("Failed to read ghosts\n");
+        return -1;
     }
 
-    pthread_rwlock_init(&board->state_lock, NULL);
-
-    for (int i = 0; i < board->height * board->width; i++) {
-        pthread_mutex_init(&board->board[i].lock, NULL);
+    if (board_build_planes(board) < 0 || build_wall_dist(board) < 0 || build_occupancy(board) < 0 ||
+        build_dot_index(board) < 0) {
+        printf("Failed to build the board planes\n");
+        return -1;
     }
+    board->n_dots = board_dots_left(board);
+    debug("Level %s: %d dots\n", filename, board->n_dots);
+    board->version++;
     
     //print_board(board);
     return 0;
 }
 
 void unload_level(board_t * board) {
-    pthread_rwlock_destroy(&board->state_lock);
-    for (int i = 0; i < board->height * board->width; i++) {
-        pthread_mutex_destroy(&board->board[i].lock);
+    for (int i = 0; i < N_PLANES; i++) plane_free(&board->planes[i]);
+    for (int d = 0; d < N_DIRS; d++) {
+        free(board->wall_dist[d]);
+        board->wall_dist[d] = NULL;
+    }
+    free(board->occ_head);
+    free(board->occ_next);
+    board->occ_head = NULL;
+    board->occ_next = NULL;
+    free(board->start_dots);
+    free(board->row_dots);
+    free(board->eaten);
+    board->start_dots = NULL;
+    board->row_dots = NULL;
+    board->eaten = NULL;
+    if (board->tiles) {
+        for (int i = 0; i < board->tiles_w * board->tiles_h; i++) {
+            if (board->tiles[i] != board->solid_tile) free(board->tiles[i]);
+        }
     }
-    free(board->board);
+    free(board->tiles);
+    free(board->solid_tile);
+    board->tiles = NULL;
+    board->solid_tile = NULL;
     free(board->pacmans);
     free(board->ghosts);
+    board->pacmans = NULL;
+    board->ghosts = NULL;
+}
+
+int board_build_planes(board_t *board) {
+    static const cell_t flags[N_PLANES] = {
+        [PLANE_WALL] = CELL_WALL,
+        [PLANE_DOT] = CELL_DOT,
+        [PLANE_PORTAL] = CELL_PORTAL,
+        [PLANE_PACMAN] = CELL_PACMAN,
+        [PLANE_GHOST] = CELL_GHOST,
+    };
+
+    for (int i = 0; i < N_PLANES; i++) {
+        if (plane_init(&board->planes[i], board->width, board->height) < 0) return -1;
+    }
+
+    for (int y = 0; y < board->height; y++) {
+        for (int x = 0; x < board->width; x++) {
+            cell_t cell = *board_cell(board, x, y);
+            if (!cell) continue;
+            for (int i = 0; i < N_PLANES; i++) {
+                if (cell & flags[i]) plane_set(&board->planes[i], x, y);
+            }
+        }
+    }
+    return 0;
+}
+
+int board_alloc_tiles(board_t *board) {
+    board->tiles_w = (board->width + 2 + TILE_MASK) >> TILE_SHIFT;
+    board->tiles_h = (board->height + 2 + TILE_MASK) >> TILE_SHIFT;
+    board->tiles = calloc((size_t)board->tiles_w * board->tiles_h, sizeof(cell_t *));
+    board->solid_tile = malloc(TILE_CELLS);
+    if (!board->tiles || !board->solid_tile) return -1;
+
+    memset(board->solid_tile, CELL_WALL, TILE_CELLS);
+    return 0;
+}
+
+int board_open_band(board_t *board, int y) {
+    cell_t **band = &board->tiles[((y + 1) >> TILE_SHIFT) * board->tiles_w];
+    for (int t = 0; t < board->tiles_w; t++) {
+        band[t] = malloc(TILE_CELLS);
+        if (!band[t]) return -1;
+        // padding past the border stays wall, so edge tiles can be shared too
+        memset(band[t], CELL_WALL, TILE_CELLS);
+    }
+    return 0;
+}
+
+void board_seal_band(board_t *board, int y) {
+    cell_t **band = &board->tiles[((y + 1) >> TILE_SHIFT) * board->tiles_w];
+    for (int t = 0; t < board->tiles_w; t++) {
+        if (band[t] && band[t] != board->solid_tile && !memcmp(band[t], board->solid_tile, TILE_CELLS)) {
+            free(band[t]);
+            band[t] = board->solid_tile;
+        }
+    }
+}
+
+cell_t *board_cell_mut(board_t *board, int x, int y) {
+    int bx = x + 1, by = y + 1;
+    cell_t **tile = &board->tiles[(by >> TILE_SHIFT) * board->tiles_w + (bx >> TILE_SHIFT)];
+    if (*tile == board->solid_tile) {
+        cell_t *copy = malloc(TILE_CELLS);
+        if (!copy) return NULL;
+        memcpy(copy, board->solid_tile, TILE_CELLS);
+        *tile = copy;
+    }
+    return board_cell(board, x, y);
+}
+
+void board_set_content(board_t *board, int x, int y, cell_t content) {
+    cell_t *cell = board_cell(board, x, y);
+
+    if (*cell & CELL_PACMAN) plane_clear(&board->planes[PLANE_PACMAN], x, y);
+    if (*cell & CELL_GHOST) plane_clear(&board->planes[PLANE_GHOST], x, y);
+    cell_set_content(cell, content);
+    touch_cell(board);
+    if (content & CELL_PACMAN) plane_set(&board->planes[PLANE_PACMAN], x, y);
+    if (content & CELL_GHOST) plane_set(&board->planes[PLANE_GHOST], x, y);
+}
+
+int board_pacman_at(board_t *board, int x, int y) {
+    for (int id = *occ_bucket(board, x, y); id != ENTITY_NONE; id = board->occ_next[id]) {
+        if (id < board->n_pacmans && board->pacmans[id].alive && occ_at(board, id, x, y)) return id;
+    }
+    return -1;
+}
+
+int board_ghost_at(board_t *board, int x, int y) {
+    for (int id = *occ_bucket(board, x, y); id != ENTITY_NONE; id = board->occ_next[id]) {
+        if (id >= board->n_pacmans && occ_at(board, id, x, y)) return id - board->n_pacmans;
+    }
+    return -1;
+}
+
+int board_dots_left(board_t *board) {
+    return plane_count(&board->planes[PLANE_DOT]);
+}
+
+int board_dot_index(board_t *board, int x, int y) {
+    int words = board->planes[PLANE_DOT].row_words;
+    const uint64_t *row = &board->start_dots[(size_t)y * words];
+
+    int index = board->row_dots[y];
+    for (int i = 0; i < x >> 6; i++) index += __builtin_popcountll(row[i]);
+    if (x & 63) index += __builtin_popcountll(row[x >> 6] & ((1ULL << (x & 63)) - 1));
+    return index;
 }
 
 void print_board(board_t *board) {
-    if (!board || !board->board) {
+    if (!board || !board->tiles) {
         debug("[%d] Board is empty or not initialized.\n", getpid());
         return;
     }
@@ -522,9 +629,8 @@ void print_board(board_t *board) {
 
     for (int y = 0; y < board->height; y++) {
         for (int x = 0; x < board->width; x++) {
-            int idx = y * board->width + x;
             if (offset < sizeof(buffer) - 2) {
-                buffer[offset++] = board->board[idx].content;
+                buffer[offset++] = cell_display(*board_cell(board, x, y));
             }
         }
         if (offset < sizeof(buffer) - 2) {
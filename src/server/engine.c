@@ -0,0 +1,791 @@
+#include "engine.h"
+#include "debug.h"
+#include "protocol.h"
+#include "common.h"
+#include "codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+static int heartbeat_ms = HEARTBEAT_MS;
+static int input_queue = 1; // plays kept in the mailbox: 1 + queued turns
+
+// quit_req values
+#define QUIT_PLAY 1
+#define QUIT_DISCONNECT 2
+
+void engine_set_heartbeat(int ms) {
+    if (ms > 0) heartbeat_ms = ms;
+}
+
+void engine_set_input_queue(int turns) {
+    if (turns >= 0 && turns < INPUT_QUEUE_MAX) input_queue = 1 + turns;
+}
+
+static void consume_requests(session_t *sess, int n) {
+    sess->in_len -= n;
+    memmove(sess->in_buf, sess->in_buf + n, (size_t)sess->in_len);
+}
+
+// Posts a play to the mailbox: once it is full the newest play replaces the last one
+static void post_play(session_t *sess, char cmd, uint32_t seq) {
+    int slot = sess->n_plays < input_queue ? sess->n_plays++ : input_queue - 1;
+    sess->play_cmd[slot] = cmd;
+    sess->play_seq[slot] = seq;
+}
+
+_Static_assert(SESSION_INPUT_SIZE >= PLAY_BATCH_HEADER + PLAY_BATCH_ENTRY * MAX_BATCH_PLAYS,
+               "a whole OP_CODE_PLAY_BATCH must fit in the session input buffer");
+
+// Appends the plays of an OP_CODE_PLAY_BATCH to the script ring (the caller checked they fit)
+static void queue_batch(session_t *sess, const unsigned char *entries, int count, uint32_t seq) {
+    for (int i = 0; i < count; i++, entries += PLAY_BATCH_ENTRY) {
+        int slot = (sess->script_head + sess->script_len++) % SCRIPT_QUEUE_SIZE;
+        sess->script_wait[slot] = get_le16(entries);
+        sess->script_cmd[slot] = (char)entries[2];
+        sess->script_seq[slot] = seq + (uint32_t)i;
+    }
+}
+
+// Applies every complete request in in_buf, leaving at most one partial request
+static void parse_requests(session_t *sess) {
+    int off = 0;
+
+    while (off < sess->in_len) {
+        const unsigned char *req = sess->in_buf + off;
+        int left = sess->in_len - off;
+
+        if (req[0] == OP_CODE_DISCONNECT) {
+            sess->quit_req = QUIT_DISCONNECT;
+            off += 1;
+        } else if (req[0] == OP_CODE_RESYNC) {
+            sess->need_level = 1;
+            sess->need_state = 1;
+            off += 1;
+        } else if (req[0] == OP_CODE_VIEWPORT) {
+            // OP_CODE_VIEWPORT | width(2) | height(2): wait for all of it
+            if (left < 5) break;
+            sess->view_w = get_le16(req + 1);
+            sess->view_h = get_le16(req + 3);
+            sess->need_state = 1;
+            off += 5;
+        } else if (req[0] == OP_CODE_PLAY) {
+            // OP_CODE_PLAY | command | seq(4): wait for all of it
+            if (left < 6) break;
+            if (req[1] == 'Q') {
+                if (!sess->quit_req) sess->quit_req = QUIT_PLAY;
+            } else {
+                post_play(sess, (char)req[1], get_le32(req + 2));
+            }
+            off += 6;
+        } else if (req[0] == OP_CODE_PLAY_BATCH) {
+            // OP_CODE_PLAY_BATCH | count(2) | seq(4) | count * (wait(2) | command): wait for all of it
+            if (left < PLAY_BATCH_HEADER) break;
+            int count = get_le16(req + 1);
+            // a dropped play would never be acked: end the session instead
+            if (count > MAX_BATCH_PLAYS || sess->script_len + count > SCRIPT_QUEUE_SIZE) {
+                debug("Rejected a batch of %d plays (%d queued)\n", count, sess->script_len);
+                sess->quit_req = QUIT_DISCONNECT;
+                off = sess->in_len;
+                break;
+            }
+            int size = PLAY_BATCH_HEADER + PLAY_BATCH_ENTRY * count;
+            if (left < size) break;
+            queue_batch(sess, req + PLAY_BATCH_HEADER, count, get_le32(req + 3));
+            off += size;
+        } else {
+            off += 1;
+        }
+    }
+    consume_requests(sess, off);
+}
+
+int engine_read_requests(session_t *sess) {
+    for (;;) {
+        ssize_t r = read(sess->req_fd, sess->in_buf + sess->in_len, (size_t)(SESSION_INPUT_SIZE - sess->in_len));
+        if (r > 0) {
+            sess->in_len += (int)r;
+            parse_requests(sess);
+            continue;
+        }
+        if (r == 0) {
+            sess->req_eof = 1; // client closed its end
+            break;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) sess->req_eof = 1;
+        break;
+    }
+    return sess->quit_req || sess->req_eof;
+}
+
+// Scripted and mailbox plays interleave: the ack only moves forward (wrap-safe)
+static void ack_play(session_t *sess, uint32_t seq) {
+    if ((int32_t)(seq - sess->play_ack) > 0) sess->play_ack = seq;
+}
+
+// Takes the next play: scripted plays first, on their tick, then the oldest of the mailbox.
+// Returns 1 if one was read into cmd, 0 if there is none this tick
+static int take_play(session_t *sess, char *cmd) {
+    engine_read_requests(sess);
+
+    if (sess->script_len > 0) {
+        int head = sess->script_head;
+        if (sess->script_wait[head] > 0) {
+            sess->script_wait[head]--;
+            return 0;
+        }
+        *cmd = sess->script_cmd[head];
+        ack_play(sess, sess->script_seq[head]);
+        sess->need_state = 1;
+        sess->script_head = (head + 1) % SCRIPT_QUEUE_SIZE;
+        sess->script_len--;
+        return 1;
+    }
+
+    if (sess->n_plays == 0) return 0;
+
+    *cmd = sess->play_cmd[0];
+    ack_play(sess, sess->play_seq[0]);
+    // the ack goes out even if the move changes nothing, so the client can reconcile
+    sess->need_state = 1;
+    sess->n_plays--;
+    memmove(sess->play_cmd, sess->play_cmd + 1, (size_t)sess->n_plays);
+    memmove(sess->play_seq, sess->play_seq + 1, (size_t)sess->n_plays * sizeof(uint32_t));
+    return 1;
+}
+
+static unsigned long long period_ms(session_t *sess, int ticks) {
+    int period = sess->board.tempo * ticks;
+    return (unsigned long long)(period > 0 ? period : 1);
+}
+
+// First deadline of a mover, anchored at the current time
+static void schedule(session_t *sess, wheel_timer_t *t, int ticks) {
+    wheel_add(sess->wheel, t, wheel_clock_ms() + period_ms(sess, ticks));
+}
+
+// Next deadline counted from the previous one, so processing and wake-up latency never add up.
+// Up to MAX_CATCHUP_TICKS missed deadlines are run back to back; past that (or for frames)
+// the missed ones are dropped, counted as overruns, and the mover stays on its grid.
+static void schedule_next(session_t *sess, wheel_timer_t *t, int ticks, int catch_up) {
+    unsigned long long period = period_ms(sess, ticks);
+    unsigned long long now = t->fired_at;
+    unsigned long long next = t->expires + period;
+
+    if (next <= now) {
+        unsigned long long missed = (now - next) / period + 1;
+        if (!catch_up || missed > MAX_CATCHUP_TICKS) {
+            sess->overruns += missed;
+            next += missed * period;
+        }
+    }
+    wheel_add(sess->wheel, t, next);
+}
+
+// Lateness of an expired timer, taken before it is rescheduled
+static void account_tick(session_t *sess, wheel_timer_t *t) {
+    unsigned long long lateness = t->fired_at - t->expires;
+    sess->ticks++;
+    if (lateness > 0) {
+        sess->late_ticks++;
+        sess->total_lateness_ms += lateness;
+        if (lateness > sess->max_lateness_ms) sess->max_lateness_ms = lateness;
+    }
+}
+
+static int step_pacman(session_t *sess) {
+    board_t *board = &sess->board;
+    pacman_t *pacman = &board->pacmans[0];
+
+    account_tick(sess, &pacman->timer);
+
+    char cmd = 0;
+    // no input: check again next tempo
+    if (!take_play(sess, &cmd)) {
+        schedule_next(sess, &pacman->timer, 1, 1);
+        return CONTINUE_PLAY;
+    }
+
+    // same spacing the old tempo * (1 + passo) sleep gave
+    schedule_next(sess, &pacman->timer, 1 + pacman->passo, 1);
+
+    // “G” desativado (ignora)
+    if (cmd == 'G') return CONTINUE_PLAY;
+
+    debug("KEY %c\n", cmd);
+
+    if (cmd == 'Q') return QUIT_GAME; // a 'Q' inside a batch
+
+    command_t play;
+    play.command = cmd;
+    play.turns = 1;
+    play.turns_left = 1;
+
+    int result = move_pacman(board, 0, &play);
+
+    if (result == REACHED_PORTAL) return NEXT_LEVEL;
+    if (result == DEAD_PACMAN) return QUIT_GAME;
+    return CONTINUE_PLAY;
+}
+
+static void step_ghost(session_t *sess, int ghost_index) {
+    board_t *board = &sess->board;
+    ghost_t *ghost = &board->ghosts[ghost_index];
+
+    account_tick(sess, &ghost->timer);
+    schedule_next(sess, &ghost->timer, 1 + ghost->passo, 1);
+
+    if (ghost->n_moves == 0) return;
+    move_ghost(board, ghost_index, &ghost->moves[ghost->current_move % ghost->n_moves]);
+}
+
+static void stop_level_timers(session_t *sess) {
+    board_t *board = &sess->board;
+
+    for (int i = 0; i < board->n_pacmans; i++) {
+        wheel_cancel(sess->wheel, &board->pacmans[i].timer);
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        wheel_cancel(sess->wheel, &board->ghosts[i].timer);
+    }
+    wheel_cancel(sess->wheel, &sess->frame_timer);
+}
+
+static void log_tick_stats(session_t *sess) {
+    debug("[client %d] ticks=%lu late=%lu overruns=%lu avg_lateness=%llums max_lateness=%llums\n",
+          sess->client_id, sess->ticks, sess->late_ticks, sess->overruns,
+          sess->ticks ? sess->total_lateness_ms / sess->ticks : 0ULL, sess->max_lateness_ms);
+}
+
+// Loads the next .lvl of the directory, or sends the final victory frame when there is none left
+static int next_level(session_t *sess) {
+    board_t *game_board = &sess->board;
+    struct dirent *entry;
+
+    while ((entry = readdir(sess->level_dir)) != NULL) {
+        debug("Checking file: %s\n", entry->d_name);
+        if (entry->d_name[0] == '.') continue;
+
+        if (sess->pending_unload) {
+            stop_level_timers(sess);
+            unload_level(game_board);
+            sess->pending_unload = 0;
+        }
+
+        char *dot = strrchr(entry->d_name, '.');
+        if (!dot || strcmp(dot, ".lvl") != 0) continue;
+
+        pthread_mutex_lock(&sess->lock);
+        sess->victory = 0;
+        sess->game_over = 0;
+        pthread_mutex_unlock(&sess->lock);
+        if (load_level(sess, entry->d_name, game_board->dirname, sess->accumulated_points) < 0) {
+            // a half-loaded board cannot be played: end the session
+            debug("Failed to load level %s\n", entry->d_name);
+            unload_level(game_board);
+            closedir(sess->level_dir);
+            sess->level_dir = NULL;
+            log_tick_stats(sess);
+            return 0;
+        }
+        engine_start_level(sess);
+
+        // update inicial
+        debug("Sending initial board update\n");
+        if (send_board_update(sess) < 0) {
+            debug("Failed to send initial board update\n");
+            pthread_mutex_lock(&sess->lock);
+            sess->disconnected = 1;
+            pthread_mutex_unlock(&sess->lock);
+            return engine_end_level(sess, QUIT_GAME);
+        }
+        return 1;
+    }
+
+    if (sess->pending_unload) {
+        pthread_mutex_lock(&sess->lock);
+        sess->victory = 1;     // vitória final
+        sess->game_over = 0;
+        pthread_mutex_unlock(&sess->lock);
+
+        (void)send_board_update(sess);
+        stop_level_timers(sess);
+        unload_level(game_board);
+        sess->pending_unload = 0;
+    }
+    closedir(sess->level_dir);
+    sess->level_dir = NULL;
+    log_tick_stats(sess);
+    return 0;
+}
+
+int engine_begin_game(session_t *sess) {
+    sess->accumulated_points = 0;
+    sess->pending_unload = 0;
+    sess->ticks = 0;
+    sess->late_ticks = 0;
+    sess->overruns = 0;
+    sess->max_lateness_ms = 0;
+    sess->total_lateness_ms = 0;
+
+    sess->level_dir = opendir(sess->board.dirname);
+    if (!sess->level_dir) {
+        debug("Failed to open levels directory: %s\n", sess->board.dirname);
+        return 0;
+    }
+    return next_level(sess);
+}
+
+int engine_end_level(session_t *sess, int result) {
+    pthread_mutex_lock(&sess->lock);
+    if (result == NEXT_LEVEL) {
+        sess->victory = 0;
+        sess->game_over = 0;
+    } else {
+        sess->game_over = 1;
+        sess->victory = 0;
+    }
+    int disconnected = sess->disconnected;
+    pthread_mutex_unlock(&sess->lock);
+
+    // Envia uma atualização final com o estado final do jogo
+    if (!disconnected) (void)send_board_update(sess);
+
+    if (result == NEXT_LEVEL) {
+        sess->pending_unload = 1;
+        sess->accumulated_points = sess->board.pacmans[0].points;
+        return next_level(sess);
+    }
+
+    stop_level_timers(sess);
+    unload_level(&sess->board);
+    closedir(sess->level_dir);
+    sess->level_dir = NULL;
+    log_tick_stats(sess);
+    return 0;
+}
+
+void engine_start_level(session_t *sess) {
+    board_t *board = &sess->board;
+
+    // every mover waits tempo * (1 + passo) before its first step
+    for (int i = 0; i < board->n_pacmans; i++) {
+        pacman_t *pacman = &board->pacmans[i];
+        pacman->timer.kind = TIMER_PACMAN;
+        pacman->timer.index = i;
+        pacman->timer.sess = sess;
+        pacman->due = 0;
+        schedule(sess, &pacman->timer, 1 + pacman->passo);
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_t *ghost = &board->ghosts[i];
+        ghost->timer.kind = TIMER_GHOST;
+        ghost->timer.index = i;
+        ghost->timer.sess = sess;
+        ghost->due = 0;
+        schedule(sess, &ghost->timer, 1 + ghost->passo);
+    }
+
+    sess->need_level = 1;
+
+    sess->frame_timer.kind = TIMER_FRAME;
+    sess->frame_timer.index = 0;
+    sess->frame_timer.sess = sess;
+    sess->frame_due = 0;
+    wheel_add(sess->wheel, &sess->frame_timer, wheel_clock_ms() + (unsigned long long)heartbeat_ms);
+}
+
+session_t* engine_timer_fired(wheel_timer_t *t) {
+    session_t *sess = t->sess;
+
+    switch (t->kind) {
+        case TIMER_PACMAN:
+            atomic_store(&sess->board.pacmans[t->index].due, 1);
+            break;
+        case TIMER_GHOST:
+            atomic_store(&sess->board.ghosts[t->index].due, 1);
+            break;
+        case TIMER_FRAME:
+            atomic_store(&sess->frame_due, 1);
+            break;
+    }
+    return sess;
+}
+
+static void move_timer(session_t *sess, wheel_timer_t *t, timing_wheel_t *to) {
+    if (wheel_cancel(sess->wheel, t)) wheel_add(to, t, t->expires);
+}
+
+void engine_move_timers(session_t *sess, timing_wheel_t *to) {
+    board_t *board = &sess->board;
+
+    if (sess->level_dir) {
+        for (int i = 0; i < board->n_pacmans; i++) move_timer(sess, &board->pacmans[i].timer, to);
+        for (int i = 0; i < board->n_ghosts; i++) move_timer(sess, &board->ghosts[i].timer, to);
+        move_timer(sess, &sess->frame_timer, to);
+    }
+    sess->wheel = to;
+}
+
+int engine_step(session_t *sess) {
+    board_t *board = &sess->board;
+
+    // quitting does not wait for the pacman's tick
+    engine_read_requests(sess);
+    if (sess->quit_req == QUIT_DISCONNECT || sess->req_eof) {
+        pthread_mutex_lock(&sess->lock);
+        sess->disconnected = 1;
+        pthread_mutex_unlock(&sess->lock);
+        return QUIT_GAME;
+    }
+    if (sess->quit_req) return QUIT_GAME;
+
+    if (atomic_exchange(&board->pacmans[0].due, 0)) {
+        int result = step_pacman(sess);
+        if (result != CONTINUE_PLAY) return result;
+    }
+
+    // ghosts always move in index order so a tick is reproducible
+    for (int i = 0; i < board->n_ghosts; i++) {
+        if (atomic_exchange(&board->ghosts[i].due, 0)) step_ghost(sess, i);
+    }
+
+    if (!board->pacmans[0].alive) {
+        pthread_mutex_lock(&sess->lock);
+        sess->game_over = 1;
+        pthread_mutex_unlock(&sess->lock);
+        debug("Game over set to 1 by ghost\n");
+        return QUIT_GAME;
+    }
+
+    // heartbeat: an idle board still gets a frame every heartbeat_ms
+    int heartbeat = atomic_exchange(&sess->frame_due, 0);
+    if (heartbeat) account_tick(sess, &sess->frame_timer);
+
+    if (engine_send_changes(sess, heartbeat) < 0) {
+        pthread_mutex_lock(&sess->lock);
+        sess->disconnected = 1;
+        pthread_mutex_unlock(&sess->lock);
+        return QUIT_GAME;
+    }
+
+    return CONTINUE_PLAY;
+}
+
+int engine_send_changes(session_t *sess, int force) {
+    if (!sess->level_dir) return 0;
+    if (!force && !sess->need_state && sess->board.version == sess->frame_version) return 0;
+
+    // client still draining the previous frame: on_output calls again once it is out.
+    // A heartbeat is kept as a pending frame, since only sending one re-arms its timer
+    if (sess->out_off < sess->out_len) {
+        if (force) sess->need_state = 1;
+        return 0;
+    }
+
+    return send_board_update(sess);
+}
+
+#define SNAPSHOT_WORDS (sizeof(session_snapshot_t) / sizeof(long))
+
+void engine_publish(session_t *sess) {
+    session_snapshot_t snap;
+
+    pthread_mutex_lock(&sess->lock);
+    snap.client_id = sess->client_id;
+    snap.active = sess->worker != NULL && !sess->disconnected;
+    snap.victory = sess->victory;
+    snap.game_over = sess->game_over;
+    pthread_mutex_unlock(&sess->lock);
+
+    board_t *board = &sess->board;
+    // between games the board is unloaded: keep the last score
+    snap.points = sess->level_dir && board->n_pacmans > 0 ? board->pacmans[0].points : sess->snap.points;
+    snap.version = (long)board->version;
+    snap.ticks = (long)sess->ticks;
+    snap.overruns = (long)sess->overruns;
+
+    // single writer (the exec_lock holder): odd sequence while the words change
+    unsigned seq = atomic_load_explicit(&sess->snap_seq, memory_order_relaxed);
+    atomic_store_explicit(&sess->snap_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    const long *src = (const long*) &snap;
+    long *dst = (long*) &sess->snap;
+    for (size_t i = 0; i < SNAPSHOT_WORDS; i++) {
+        __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+    }
+
+    atomic_store_explicit(&sess->snap_seq, seq + 2, memory_order_release);
+}
+
+void engine_read_snapshot(session_t *sess, session_snapshot_t *out) {
+    const long *src = (const long*) &sess->snap;
+    long *dst = (long*) out;
+    unsigned before, after;
+
+    do {
+        before = atomic_load_explicit(&sess->snap_seq, memory_order_acquire);
+        for (size_t i = 0; i < SNAPSHOT_WORDS; i++) {
+            dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&sess->snap_seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
+
+// Makes room for n more bytes at the end of the output buffer
+static char* out_reserve(session_t *sess, size_t n) {
+    // drop what was already written before growing
+    if (sess->out_off > 0) {
+        sess->out_len -= sess->out_off;
+        memmove(sess->out_buf, sess->out_buf + sess->out_off, sess->out_len);
+        sess->out_off = 0;
+    }
+
+    if (sess->out_len + n > sess->out_cap) {
+        size_t cap = sess->out_cap ? sess->out_cap : 1024;
+        while (cap < sess->out_len + n) cap *= 2;
+        char *buf = realloc(sess->out_buf, cap);
+        if (!buf) return NULL;
+        sess->out_buf = buf;
+        sess->out_cap = cap;
+    }
+
+    char *dst = sess->out_buf + sess->out_len;
+    sess->out_len += n;
+    return dst;
+}
+
+int engine_flush(session_t *sess) {
+    while (sess->out_off < sess->out_len) {
+        ssize_t w = write(sess->notif_fd, sess->out_buf + sess->out_off, sess->out_len - sess->out_off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            return -1;
+        }
+        sess->out_off += (size_t)w;
+    }
+    sess->out_off = 0;
+    sess->out_len = 0;
+    if (sess->out_cap > OUT_BUF_KEEP) {
+        free(sess->out_buf);
+        sess->out_buf = NULL;
+        sess->out_cap = 0;
+    }
+    return 0;
+}
+
+// Encodes the n display chars of the static layer into out (room for n bytes) with the
+// smallest codec the client accepts. Returns the bytes written and sets *codec
+static int encode_cells(session_t *sess, const char *cells, int n, unsigned char *out, int *codec) {
+    // PACK4 always takes (n + 1) / 2 bytes: RLE is tried first, only up to that size
+    int pack4 = (sess->codecs & CODEC_BIT(CODEC_PACK4)) != 0;
+    if (sess->codecs & CODEC_BIT(CODEC_RLE)) {
+        int limit = pack4 ? (n + 1) / 2 - 1 : n - 1;
+        int rle = limit > 0 ? codec_encode(CODEC_RLE, cells, (size_t)n, out, (size_t)limit) : -1;
+        if (rle >= 0) {
+            *codec = CODEC_RLE;
+            return rle;
+        }
+    }
+    if (pack4) {
+        int packed = codec_encode(CODEC_PACK4, cells, (size_t)n, out, (size_t)n);
+        if (packed >= 0) {
+            *codec = CODEC_PACK4;
+            return packed;
+        }
+    }
+
+    *codec = CODEC_RAW;
+    memcpy(out, cells, (size_t)n);
+    return n;
+}
+
+static void put_frame_head(unsigned char *frame, int op, int codec, size_t payload) {
+    frame[0] = (unsigned char)op;
+    frame[1] = PROTOCOL_VERSION;
+    frame[2] = (unsigned char)codec;
+    frame[3] = 0;
+    put_le32(frame + 4, (uint32_t)payload);
+}
+
+// OP_CODE_LEVEL: dimensions, tempo and the static layer, encoded
+static int queue_level(session_t *sess) {
+    board_t *board = &sess->board;
+    int n = board->width * board->height;
+    size_t head = FRAME_HEADER_SIZE + 4 * LEVEL_FIELDS;
+
+    // the layer is only rendered here, once per level and client, and encoded
+    // straight into the output buffer
+    char *layer = malloc((size_t)n);
+    if (!layer) return -1;
+    for (int y = 0; y < board->height; y++) {
+        for (int x = 0; x < board->width; x++) {
+            layer[y * board->width + x] = cell_static(*board_cell(board, x, y));
+        }
+    }
+
+    unsigned char *frame = (unsigned char*) out_reserve(sess, head + (size_t)n);
+    if (!frame) {
+        free(layer);
+        return -1;
+    }
+
+    int codec;
+    int len = encode_cells(sess, layer, n, frame + head, &codec);
+    free(layer);
+    put_frame_head(frame, OP_CODE_LEVEL, codec, head - FRAME_HEADER_SIZE + (size_t)len);
+    put_le32(frame + FRAME_HEADER_SIZE, (uint32_t)board->width);
+    put_le32(frame + FRAME_HEADER_SIZE + 4, (uint32_t)board->height);
+    put_le32(frame + FRAME_HEADER_SIZE + 8, (uint32_t)board->tempo);
+    put_le32(frame + FRAME_HEADER_SIZE + 12, (uint32_t)board->n_dots);
+    put_le32(frame + FRAME_HEADER_SIZE + 16, (uint32_t)input_queue);
+    sess->out_len -= (size_t)(n - len);
+
+    sess->need_level = 0;
+    return 0;
+}
+
+static unsigned char* put_position(unsigned char *p, int x, int y) {
+    put_le16(p, (uint16_t)x);
+    put_le16(p + 2, (uint16_t)y);
+    return p + 4;
+}
+
+// Window origin along one axis: kept while pos stays a quarter span away from its edges
+static int slide_window(int origin, int pos, int span, int size) {
+    int margin = span / 4;
+    if (pos < origin + margin || pos >= origin + span - margin) origin = pos - span / 2;
+    if (origin > size - span) origin = size - span;
+    if (origin < 0) origin = 0;
+    return origin;
+}
+
+// Part of the board the client sees: its viewport around pacman, or the whole board
+static void place_window(session_t *sess, int *w, int *h) {
+    board_t *board = &sess->board;
+    pacman_t *pac = &board->pacmans[0];
+
+    *w = sess->view_w > 0 && sess->view_w < board->width ? sess->view_w : board->width;
+    *h = sess->view_h > 0 && sess->view_h < board->height ? sess->view_h : board->height;
+    if (pac->alive) {
+        sess->view_x = slide_window(sess->view_x, pac->pos_x, *w, board->width);
+        sess->view_y = slide_window(sess->view_y, pac->pos_y, *h, board->height);
+    } else {
+        sess->view_x = slide_window(sess->view_x, sess->view_x, *w, board->width);
+        sess->view_y = slide_window(sess->view_y, sess->view_y, *h, board->height);
+    }
+}
+
+static int in_window(session_t *sess, int w, int h, int x, int y) {
+    return x >= sess->view_x && x < sess->view_x + w && y >= sess->view_y && y < sess->view_y + h;
+}
+
+// Copies n bits of src from bit from to bit k of dst, 8 at a time. The bytes of
+// dst from bit k on are written, not or-ed, so they need no clearing
+static void copy_bits(unsigned char *dst, int k, const unsigned char *src, int from, int n) {
+    while (n > 0) {
+        int c = n < 8 ? n : 8;
+        unsigned v = src[from >> 3] >> (from & 7);
+        if ((from & 7) + c > 8) v |= (unsigned)src[(from >> 3) + 1] << (8 - (from & 7));
+        v &= (1u << c) - 1;
+
+        int shift = k & 7;
+        if (shift == 0) {
+            dst[k >> 3] = (unsigned char)v;
+        } else {
+            dst[k >> 3] |= (unsigned char)(v << shift);
+            if (shift + c > 8) dst[(k >> 3) + 1] = (unsigned char)(v >> (8 - shift));
+        }
+        from += c;
+        k += c;
+        n -= c;
+    }
+}
+
+// OP_CODE_STATE: status, window, the entities inside it and its eaten dots bitmap
+static int queue_state(session_t *sess) {
+    board_t *board = &sess->board;
+    int w, h;
+    place_window(sess, &w, &h);
+
+    // room for the worst case, trimmed once the window is walked
+    size_t max = 4 * STATE_FIELDS + 8 + 4 * (size_t)(board->n_pacmans + board->n_ghosts) + (size_t)(w * h + 7) / 8;
+    unsigned char *frame = (unsigned char*) out_reserve(sess, FRAME_HEADER_SIZE + max);
+    if (!frame) return -1;
+
+    unsigned char *fields = frame + FRAME_HEADER_SIZE;
+    pthread_mutex_lock(&sess->lock);
+    put_le32(fields, (uint32_t)sess->victory);
+    put_le32(fields + 4, (uint32_t)sess->game_over);
+    pthread_mutex_unlock(&sess->lock);
+    put_le32(fields + 8, (uint32_t)(board->n_pacmans > 0 ? board->pacmans[0].points : 0));
+
+    unsigned char *p = fields + 4 * STATE_FIELDS;
+    p = put_position(p, sess->view_x, sess->view_y);
+    p = put_position(p, w, h);
+
+    int n_pacmans = 0, n_ghosts = 0;
+    for (int i = 0; i < board->n_pacmans; i++) {
+        pacman_t *pac = &board->pacmans[i];
+        if (!pac->alive || !in_window(sess, w, h, pac->pos_x, pac->pos_y)) continue;
+        p = put_position(p, pac->pos_x, pac->pos_y);
+        n_pacmans++;
+    }
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_t *ghost = &board->ghosts[i];
+        if (!in_window(sess, w, h, ghost->pos_x, ghost->pos_y)) continue;
+        p = put_position(p, ghost->pos_x, ghost->pos_y);
+        n_ghosts++;
+    }
+    put_le32(fields + 12, (uint32_t)n_pacmans);
+    put_le32(fields + 16, (uint32_t)n_ghosts);
+    put_le32(fields + 20, sess->play_ack);
+
+    // one bit per starting dot of the window, row-major inside it: each window row
+    // is a run of the level's eaten bitmap
+    int k = 0;
+    for (int y = sess->view_y; y < sess->view_y + h; y++) {
+        int first = board_dot_index(board, sess->view_x, y);
+        int count = board_dot_index(board, sess->view_x + w, y) - first;
+        copy_bits(p, k, board->eaten, first, count);
+        k += count;
+    }
+    p += (k + 7) / 8;
+
+    size_t payload = (size_t)(p - fields);
+    put_frame_head(frame, OP_CODE_STATE, CODEC_RAW, payload);
+    sess->out_len -= max - payload;
+    return 0;
+}
+
+int send_board_update(session_t *sess) {
+    board_t *board = &sess->board;
+
+    // Safety check
+    if (board->width <= 0 || board->height <= 0 || !board->tiles || !board->pacmans) {
+        return -1;
+    }
+
+    if (sess->need_level && queue_level(sess) < 0) return -1;
+    if (queue_state(sess) < 0) return -1;
+
+    sess->frame_version = board->version;
+    sess->need_state = 0;
+
+    // any frame proves liveness: push the heartbeat back
+    wheel_cancel(sess->wheel, &sess->frame_timer);
+    wheel_add(sess->wheel, &sess->frame_timer, wheel_clock_ms() + (unsigned long long)heartbeat_ms);
+
+    if (engine_flush(sess) < 0) {
+        debug("Failed to write board update\n");
+        return -1;
+    }
+    return 0;
+}
@@ -1,4 +1,6 @@
 #include "board.h"
+#include "engine.h"
+#include "worker.h"
 #include "display.h"
 #include "debug.h"
 #include "common.h"
@@ -18,12 +20,6 @@
 #include <signal.h>
 #include <ctype.h>
 
-#define CONTINUE_PLAY 0
-#define NEXT_LEVEL 1
-#define QUIT_GAME 2
-#define LOAD_BACKUP 3
-#define CREATE_BACKUP 4
-
 static volatile sig_atomic_t got_sigusr1 = 0;
 
 static void on_sigusr1(int sig) {
@@ -31,22 +27,17 @@ static void on_sigusr1(int sig) {
     got_sigusr1 = 1;
 }
 
-typedef struct {
-    session_t *session;
-    int ghost_index;
-} ghost_thread_arg_t;
-
-typedef struct {
-    session_t *session;
-    const char* level_dir;
-} session_thread_arg_t;
-
 typedef struct {
     int *register_fd;
     session_t *sessions;
     int max_games;
 } manager_thread_arg_t;
 
+typedef struct {
+    session_t *sess;
+    client_con_req_t con_req;
+} opener_thread_arg_t;
+
 typedef struct {
     int id;
     int points;
@@ -68,24 +59,15 @@ static void dump_top5(session_t *sessions, int max_games) {
 
     int count = 0;
     for (int i = 0; i < max_games; i++) {
-        session_t *sess = &sessions[i];
+        // snapshot publicado pela sessão: não bloqueia o jogo
+        session_snapshot_t snap;
+        engine_read_snapshot(&sessions[i], &snap);
 
         // verificar se "com sessão ativa"
-        pthread_mutex_lock(&sessions[i].lock);
-        int req_fd = sess->req_fd;
-        int notif_fd = sess->notif_fd;
-        int disconnected = sess->disconnected;
-        int client_id = sess->client_id;
-        pthread_mutex_unlock(&sessions[i].lock);
-
-        if (req_fd < 0 || notif_fd < 0 || disconnected) continue;
+        if (!snap.active) continue;
 
-        pthread_rwlock_rdlock(&sess->board.state_lock);
-        int points = (sess->board.n_pacmans > 0) ? sess->board.pacmans[0].points : 0;
-        pthread_rwlock_unlock(&sess->board.state_lock);
-
-        top_players[count].id = client_id;
-        top_players[count].points = points;
+        top_players[count].id = (int)snap.client_id;
+        top_players[count].points = (int)snap.points;
         count++;
     }
 
@@ -140,6 +122,7 @@ static void queue_init(client_queue_t* q) {
     q->head = 0;
     q->tail = 0;
     q->count = 0;
+    q->closed = 0;
     pthread_mutex_init(&q->mutex, NULL);
     sem_init(&q->sem_empty, 0, MAX_PENDING_CLIENTS);     // todos os slots estão vazios
     sem_init(&q->sem_full, 0, 0);                        // nenhum pedido disponível
@@ -157,18 +140,31 @@ static void queue_add(client_queue_t* q, client_con_req_t* req) {
     sem_post(&q->sem_full);
 }
 
-static client_con_req_t queue_remove(client_queue_t* q) {
+// Devolve 0 com o pedido mais antigo em req, ou -1 se a fila foi fechada
+static int queue_remove(client_queue_t* q, client_con_req_t* req) {
     sem_wait(&q->sem_full);
     pthread_mutex_lock(&q->mutex);
 
-    client_con_req_t req = q->requests[q->head];
+    if (q->closed) {
+        pthread_mutex_unlock(&q->mutex);
+        sem_post(&q->sem_full); // acordar o proximo tambem
+        return -1;
+    }
+    *req = q->requests[q->head];
     q->head = (q->head + 1) % MAX_PENDING_CLIENTS;
     q->count--;
 
     pthread_mutex_unlock(&q->mutex);
     sem_post(&q->sem_empty);
 
-    return req;
+    return 0;
+}
+
+static void queue_close(client_queue_t* q) {
+    pthread_mutex_lock(&q->mutex);
+    q->closed = 1;
+    pthread_mutex_unlock(&q->mutex);
+    sem_post(&q->sem_full);
 }
 
 static int exctract_client_id(const char* pipe_path) {
@@ -185,235 +181,6 @@ static int exctract_client_id(const char* pipe_path) {
     return (int)v;
 }
 
-void* pacman_thread(void *arg) {
-    session_t *sess = (session_t*) arg;
-    board_t *board = &sess->board;
-
-    pacman_t* pacman = &board->pacmans[0];
-
-    int *retval = malloc(sizeof(int));
-
-    pthread_mutex_lock(&sess->lock);
-    if (sess->shutdown) {
-        pthread_mutex_unlock(&sess->lock);
-        pthread_exit(NULL);
-    }
-    pthread_mutex_unlock(&sess->lock);
-
-    while (true) {
-        sleep_ms(board->tempo * (1 + pacman->passo));
-
-        unsigned char op = 0;
-
-        if (read_full(sess->req_fd, &op, 1) != 1) {
-            pthread_mutex_lock(&sess->lock);
-            sess->disconnected = 1;  
-            pthread_mutex_unlock(&sess->lock);
-            *retval = QUIT_GAME;
-            return (void*) retval;
-        }
-
-        if (op == OP_CODE_DISCONNECT) {
-            pthread_mutex_lock(&sess->lock);
-            sess->disconnected = 1;          
-            pthread_mutex_unlock(&sess->lock);
-            *retval = QUIT_GAME;
-            return (void*) retval;
-        }
-
-        if (op == OP_CODE_PLAY) {
-            unsigned char cmd = 0;
-            if (read_full(sess->req_fd, &cmd, 1) != 1) {
-                pthread_mutex_lock(&sess->lock);
-                sess->disconnected = 1;
-                pthread_mutex_unlock(&sess->lock);
-                *retval = QUIT_GAME;
-                return (void*) retval;
-            }
-
-            // “G” desativado (ignora)
-            if ((char)cmd == 'G') continue;
-
-            command_t play;
-            play.command = (char)cmd;
-            
-            debug("KEY %c\n", play.command);
-
-            // QUIT
-            if (play.command == 'Q') {
-                *retval = QUIT_GAME;
-                return (void*) retval;
-            }
-
-            pthread_rwlock_wrlock(&board->state_lock);
-            int result = move_pacman(board, 0, &play);
-            pthread_rwlock_unlock(&board->state_lock);
-
-            if (result == REACHED_PORTAL) {
-                *retval = NEXT_LEVEL;
-                break;
-            }
-
-            if(result == DEAD_PACMAN) {
-                *retval = QUIT_GAME;
-                break;
-            }
-        }            
-    }
-    return (void*) retval;
-}
-
-void* ghost_thread(void *arg) {
-    ghost_thread_arg_t *ghost_arg = (ghost_thread_arg_t*) arg;
-    board_t *board = &ghost_arg->session->board;
-    session_t *sess = ghost_arg->session;
-    int ghost_ind = ghost_arg->ghost_index;
-
-    free(ghost_arg);
-
-    ghost_t* ghost = &board->ghosts[ghost_ind];
-
-    while (true) {
-        sleep_ms(board->tempo * (1 + ghost->passo));
-
-        pthread_mutex_lock(&sess->lock);
-        int stop = sess->shutdown;
-        pthread_mutex_unlock(&sess->lock);
-
-        if (stop) {
-            pthread_exit(NULL);
-        }
-        
-        pthread_rwlock_wrlock(&board->state_lock);
-        int result = move_ghost(board, ghost_ind, &ghost->moves[ghost->current_move%ghost->n_moves]);
-        pthread_rwlock_unlock(&board->state_lock);
-
-        if (result == DEAD_PACMAN) {
-            pthread_mutex_lock(&sess->lock);
-            sess->game_over = 1;
-            pthread_mutex_unlock(&sess->lock);
-            debug("Game over set to 1 by ghost\n");
-        }
-    }
-}
-
-int send_board_update(session_t *sess) {
-    board_t *board = &sess->board;
-    
-    pthread_rwlock_rdlock(&board->state_lock);
-    int n = board->width * board->height;
-    
-    // Safety check
-    if (n <= 0 || !board->board || !board->pacmans) {
-        pthread_rwlock_unlock(&board->state_lock);
-        return -1;
-    }
-    
-    char *buf = malloc((size_t)n);
-    if (!buf) {
-        pthread_rwlock_unlock(&board->state_lock);
-        return -1;
-    }
-    
-    for (int i = 0; i < n; i++) {
-        // Dados do tabuleiro (converter para formato do cliente)
-        char ch = board->board[i].content;
-        
-        // Converter caracteres para o formato de display
-        switch (ch) {
-            case 'W': // Wall
-                buf[i] = '#';
-                break;
-            case 'P': // Pacman
-                buf[i] = 'C';
-                break;
-            case 'M': // Ghost
-                buf[i] = 'M';
-                break;
-            case ' ': // Empty space
-                if (board->board[i].has_portal) {
-                    buf[i] = '@';
-                } else if (board->board[i].has_dot) {
-                    buf[i] = '.';
-                } else {
-                    buf[i] = ' ';
-                }
-                break;
-            default:
-                buf[i] = ch;
-                break;
-        }
-    }
-   
-    int w = board->width, h = board->height;
-    int tempo = board->tempo;
-    int points = (board->n_pacmans > 0) ? board->pacmans[0].points : 0;
-    pthread_rwlock_unlock(&board->state_lock);
-    
-    pthread_mutex_lock(&sess->lock);
-    int victory, game_over;
-    victory = sess->victory;
-    game_over = sess->game_over;
-    pthread_mutex_unlock(&sess->lock);
-    
-    // OP_CODE_BOARD: OP(1) + 6 ints + board_data[w*h]
-    unsigned char op = OP_CODE_BOARD;
-    if (write_full(sess->notif_fd, &op, 1) < 0) { debug("Failed to write op code"); free(buf); return -1; }
-    if (write_full(sess->notif_fd, &w, sizeof(int)) < 0) { free(buf); return -1; }
-    if (write_full(sess->notif_fd, &h, sizeof(int)) < 0) { free(buf); return -1; }
-    if (write_full(sess->notif_fd, &tempo, sizeof(int)) < 0) { free(buf); return -1; }
-    if (write_full(sess->notif_fd, &victory, sizeof(int)) < 0) { free(buf); return -1; }
-    if (write_full(sess->notif_fd, &game_over, sizeof(int)) < 0) { free(buf); return -1; }
-    if (write_full(sess->notif_fd, &points, sizeof(int)) < 0) { free(buf); return -1; }
-    if (write_full(sess->notif_fd, buf, (size_t)n) < 0) { free(buf); return -1; }
-
-    free(buf);
-
-    return 0;
-}
-
-static void* send_board_update_thread(void *arg) {
-    session_t *sess = (session_t*)arg;
-    
-    // update inicial
-    debug("Sending initial board update\n");
-    if (send_board_update(sess) < 0) {
-        debug("Failed to send initial board update\n");
-        pthread_mutex_lock(&sess->lock);
-        sess->disconnected = 1;
-        sess->shutdown = 1;
-        pthread_mutex_unlock(&sess->lock);
-        return NULL;
-    }
-
-    while (1) {
-        pthread_mutex_lock(&sess->lock);
-        int stop = sess->shutdown;
-        pthread_mutex_unlock(&sess->lock);
-        if (stop) break;
-
-        sleep_ms(sess->board.tempo);
-
-        if (send_board_update(sess) < 0) {
-            pthread_mutex_lock(&sess->lock);
-            sess->disconnected = 1;
-            sess->shutdown = 1;
-            pthread_mutex_unlock(&sess->lock);
-            break;
-        }
-    }
-
-    // Envia uma atualização final com o estado final do jogo
-    pthread_mutex_lock(&sess->lock);
-    int should_send_final = !sess->disconnected;
-    pthread_mutex_unlock(&sess->lock);
-    
-    if (should_send_final) {
-        (void)send_board_update(sess);
-    }
-    return NULL;
-}
-
 static void* manager_thread(void *arg) {
     manager_thread_arg_t *mgr_arg = (manager_thread_arg_t*) arg;
     int *register_fd = mgr_arg->register_fd;
@@ -450,14 +217,15 @@ static void* manager_thread(void *arg) {
         
         // Ler caminhos dos FIFOs
         if (read_full_host(*register_fd, con_req.req_pipe_path, MAX_PIPE_PATH_LENGTH, sessions, max_games) != 1 ||
-            read_full_host(*register_fd, con_req.notif_pipe_path, MAX_PIPE_PATH_LENGTH, sessions, max_games) != 1) {
+            read_full_host(*register_fd, con_req.notif_pipe_path, MAX_PIPE_PATH_LENGTH, sessions, max_games) != 1 ||
+            read_full_host(*register_fd, &con_req.codecs, 1, sessions, max_games) != 1) {
             debug("Failed to read pipe paths in manager_thread\n");
             break;
         }
 
         con_req.req_pipe_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
         con_req.notif_pipe_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
-        debug("[HOST] CONNECT req=%s notif=%s\n", con_req.req_pipe_path, con_req.notif_pipe_path);
+        debug("[HOST] CONNECT req=%s notif=%s codecs=0x%x\n", con_req.req_pipe_path, con_req.notif_pipe_path, con_req.codecs);
 
         queue_add(&queue, &con_req);
     }
@@ -465,202 +233,122 @@ static void* manager_thread(void *arg) {
     return NULL;
 }
 
-static void run_session_game(session_t *sess) {
-    int accumulated_points = 0;
-    bool end_game = false;
-    bool pending_unload = false; 
-    board_t *game_board = &sess->board;
-
-    DIR* entry_dir = opendir(sess->board.dirname);
-    if (!entry_dir) {
-        debug("Failed to open levels directory: %s\n", sess->board.dirname);
-        return;
+// The client opens its notification FIFO once it got the request one: until then a
+// non-blocking open for writing fails with ENXIO. Retries for at most CONNECT_TIMEOUT_MS
+static int open_notif(const char *path) {
+    for (int waited = 0; ; waited += CONNECT_RETRY_MS) {
+        int fd = open(path, O_WRONLY | O_NONBLOCK);
+        if (fd >= 0 || errno != ENXIO || waited >= CONNECT_TIMEOUT_MS) return fd;
+        sleep_ms(CONNECT_RETRY_MS);
     }
+}
 
-    struct dirent* entry;
-
-    while ((entry = readdir(entry_dir)) != NULL && !end_game) {
-        debug("Checking file: %s\n", entry->d_name);
-        if (entry->d_name[0] == '.') continue;
-
-        if (pending_unload) {
-            unload_level(game_board);
-            pending_unload = false;
-        }
-
-        char *dot = strrchr(entry->d_name, '.');
-        if (!dot) continue;
-
-        if (strcmp(dot, ".lvl") == 0) {
-            pthread_mutex_lock(&sess->lock);
-            sess->victory = 0;
-            sess->game_over = 0;
-            pthread_mutex_unlock(&sess->lock);
-            load_level(sess, entry->d_name, sess->board.dirname, accumulated_points);
-
-            while(true) {
-                pthread_t pacman_tid, send_update_tid;
-                pthread_t *ghost_tids = malloc(game_board->n_ghosts * sizeof(pthread_t));
-                if (!ghost_tids) {
-                    debug("Failed to allocate ghost_tids\n");
-                    end_game = true;
-                    break;
-                }
-
-                pthread_mutex_lock(&sess->lock);
-                sess->shutdown = 0;
-                pthread_mutex_unlock(&sess->lock);
-
-                debug("Creating threads\n");
-
-                pthread_create(&pacman_tid, NULL, pacman_thread, (void*) sess);
-
-                for (int i = 0; i < game_board->n_ghosts; i++) {
-                    ghost_thread_arg_t *arg = malloc(sizeof(ghost_thread_arg_t));
-                    arg->session = sess;
-                    arg->ghost_index = i;
-                    pthread_create(&ghost_tids[i], NULL, ghost_thread, (void*) arg);
-                }
-
-                pthread_create(&send_update_tid, NULL, send_board_update_thread, (void*)sess);
-
-                debug("Threads created\n");
+// Opens the FIFOs of a client and hands its session to a worker, or frees the slot
+static void open_session(session_t *sess, const client_con_req_t *con_req) {
+    int client_id = exctract_client_id(con_req->req_pipe_path);
+    pthread_mutex_lock(&sess->lock);
+    sess->client_id = client_id;
+    pthread_mutex_unlock(&sess->lock);
 
-                int *retval = NULL;
-                pthread_join(pacman_tid, (void**)&retval);
+    // non-blocking: a client that dies before opening its end never holds up the server
+    int req_fd = open(con_req->req_pipe_path, O_RDONLY | O_NONBLOCK);
+    int notif_fd = req_fd >= 0 ? open_notif(con_req->notif_pipe_path) : -1;
 
-                int result = QUIT_GAME;
-                if (retval) {
-                    result = *retval;
-                    free(retval);
-                } else {
-                    debug("Pacman thread returned NULL\n");
-                }
+    unsigned char op = OP_CODE_CONNECT;
+    unsigned char result = 0; // sucesso
 
-                pthread_mutex_lock(&sess->lock);
-                if (result == NEXT_LEVEL) {
-                    sess->victory = 0;
-                    sess->game_over = 0;
-                } else if (result == QUIT_GAME) {
-                    sess->game_over = 1;
-                    sess->victory = 0;
-                }
-                pthread_mutex_unlock(&sess->lock);
+    if (req_fd < 0 || notif_fd < 0) {
+        debug("Failed to open pipes for session\n");
+        result = 1; // falha
+        if (notif_fd >= 0) {
+            write_full(notif_fd, &op, 1);
+            write_full(notif_fd, &result, 1);
+            close(notif_fd);
+        }
+        if (req_fd >= 0) close(req_fd);
+        workers_release_slot(sess);
+        return;
+    }
 
-                (void)send_board_update(sess);
+    // enviar resposta de connect
+    if (write_full(notif_fd, &op, 1) < 0 ||
+        write_full(notif_fd, &result, 1) < 0) {
+        debug("Failed to write connection response for session\n");
+        close(req_fd);
+        close(notif_fd);
+        workers_release_slot(sess);
+        return;
+    }
 
-                // Stop threads
-                pthread_mutex_lock(&sess->lock);
-                sess->shutdown = 1;
-                pthread_mutex_unlock(&sess->lock);
+    debug("Pipes opened successfully for session\n");
 
-                for (int i = 0; i < game_board->n_ghosts; i++) {
-                    pthread_join(ghost_tids[i], NULL);
-                }
-                pthread_join(send_update_tid, NULL);
+    pthread_mutex_lock(&sess->lock);
+    sess->req_fd = req_fd;
+    sess->notif_fd = notif_fd;
+    sess->codecs = con_req->codecs;
+    sess->view_w = 0;
+    sess->view_h = 0;
+    sess->play_ack = 0;
+    sess->disconnected = 0;
+    sess->victory = 0;
+    sess->game_over = 0;
+    pthread_mutex_unlock(&sess->lock);
 
-                free(ghost_tids);
+    workers_attach(sess);
+}
 
-                if(result == NEXT_LEVEL) {
-                    pending_unload = true;
-                    accumulated_points = sess->board.pacmans[0].points;
-                    break;
-                }
+// opener threads still running: main waits for them before stopping the workers
+static int n_openers = 0;
+static pthread_mutex_t openers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t openers_done = PTHREAD_COND_INITIALIZER;
 
-                if(result == QUIT_GAME) {
-                    unload_level(game_board);
-                    end_game = true;
-                    break;
-                }
+static void* opener_thread(void *arg) {
+    opener_thread_arg_t *op_arg = (opener_thread_arg_t*) arg;
+    open_session(op_arg->sess, &op_arg->con_req);
+    free(op_arg);
 
-                accumulated_points = sess->board.pacmans[0].points;      
-            }
-        }
-    }  
-    if (!end_game && pending_unload) {
-        pthread_mutex_lock(&sess->lock);
-        sess->victory = 1;     // vitória final
-        sess->game_over = 0;
-        pthread_mutex_unlock(&sess->lock);
-
-        (void)send_board_update(sess);
-        unload_level(game_board);
-        pending_unload = false;
-    }
-    closedir(entry_dir);
+    pthread_mutex_lock(&openers_lock);
+    if (--n_openers == 0) pthread_cond_broadcast(&openers_done);
+    pthread_mutex_unlock(&openers_lock);
+    return NULL;
 }
 
-static void* session_thread(void *arg) {
-    session_thread_arg_t *sess_arg = (session_thread_arg_t*) arg;
-    session_t *sess = sess_arg->session;
-
-    pthread_mutex_init(&sess->lock, NULL);
-    strncpy(sess->board.dirname, sess_arg->level_dir, MAX_FILENAME);
-    sess->board.dirname[MAX_FILENAME - 1] = '\0';
+// Takes a free slot per queued client; each handshake runs on its own opener thread,
+// so a client that stalls before opening its FIFOs only holds its own slot
+static void* acceptor_thread(void *arg) {
+    (void)arg;
 
     while (1) {
-        debug("Session thread waiting for new connection...\n");
-        client_con_req_t con_req = queue_remove(&queue);
-        debug("Session thread got new connection: req=%s notif=%s\n", con_req.req_pipe_path, con_req.notif_pipe_path);
-
-        int client_id = exctract_client_id(con_req.req_pipe_path);
-        pthread_mutex_lock(&sess->lock);
-        sess->client_id = client_id;
-        pthread_mutex_unlock(&sess->lock);
-
-        int req_fd = open(con_req.req_pipe_path, O_RDONLY);
-        int notif_fd = open(con_req.notif_pipe_path, O_WRONLY);
-
-        unsigned char op = OP_CODE_CONNECT;
-        unsigned char result = 0; // sucesso
-
-        if (req_fd < 0 || notif_fd < 0) {
-            debug("Failed to open pipes for session\n");
-            result = 1; // falha
-            if (notif_fd >= 0) {
-                write_full(notif_fd, &op, 1);
-                write_full(notif_fd, &result, 1);
-                close(notif_fd);
-            }
-            if (req_fd >= 0) close(req_fd);
-            continue;
-        }
+        session_t *sess = workers_acquire_slot();
+        if (!sess) break;
 
-        // enviar resposta de connect
-        if (write_full(notif_fd, &op, 1) < 0 ||
-            write_full(notif_fd, &result, 1) < 0) {
-            debug("Failed to write connection response for session\n");
-            close(req_fd);
-            close(notif_fd);
-            continue;
+        debug("Acceptor waiting for new connection...\n");
+        client_con_req_t con_req;
+        if (queue_remove(&queue, &con_req) < 0) {
+            workers_release_slot(sess);
+            break;
         }
-
-        debug("Pipes opened successfully for session\n");
-
-        pthread_mutex_lock(&sess->lock);
-        sess->req_fd = req_fd;
-        sess->notif_fd = notif_fd;
-        sess->disconnected = 0;
-        sess->victory = 0;
-        sess->game_over = 0;
-        sess->shutdown = 0;
-        pthread_mutex_unlock(&sess->lock);
-
-        // corre o jogo
-        debug("Starting session game...\n");
-        run_session_game(sess);
-
-        // cleanup do cliente mas a session continua ativa
-        close(req_fd);
-        close(notif_fd);
-
-        pthread_mutex_lock(&sess->lock);
-        sess->req_fd = -1;
-        sess->notif_fd = -1;
-        pthread_mutex_unlock(&sess->lock);
-
-        debug("Session ended, waiting for next connection...\n");
-
+        debug("Acceptor got new connection: req=%s notif=%s\n", con_req.req_pipe_path, con_req.notif_pipe_path);
+
+        opener_thread_arg_t *op_arg = malloc(sizeof(opener_thread_arg_t));
+        pthread_t opener_tid;
+        if (op_arg) {
+            op_arg->sess = sess;
+            op_arg->con_req = con_req;
+            pthread_mutex_lock(&openers_lock);
+            n_openers++;
+            pthread_mutex_unlock(&openers_lock);
+            if (pthread_create(&opener_tid, NULL, opener_thread, (void*) op_arg) == 0) {
+                pthread_detach(opener_tid);
+                continue;
+            }
+            pthread_mutex_lock(&openers_lock);
+            n_openers--;
+            pthread_mutex_unlock(&openers_lock);
+            free(op_arg);
+        }
+        debug("Failed to start an opener thread, opening the FIFOs here\n");
+        open_session(sess, &con_req);
     }
 
     return NULL;
@@ -717,6 +405,14 @@ int main(int argc,char *argv[]) {
 
     // alocar sessions
     session_t *sessions = calloc((size_t)max_games, sizeof(session_t));
+    for (int i = 0; i < max_games; i++) {
+        pthread_mutex_init(&sessions[i].lock, NULL);
+        pthread_mutex_init(&sessions[i].exec_lock, NULL);
+        strncpy(sessions[i].board.dirname, level_dir, MAX_FILENAME);
+        sessions[i].board.dirname[MAX_FILENAME - 1] = '\0';
+        sessions[i].req_fd = -1;
+        sessions[i].notif_fd = -1;
+    }
 
     // manager thread
     pthread_t manager_tid;
@@ -726,29 +422,46 @@ int main(int argc,char *argv[]) {
     manager_arg.max_games = max_games;
     pthread_create(&manager_tid, NULL, manager_thread, (void*)&manager_arg);
 
-    // sessions threads
-    pthread_t *session_tid = malloc(max_games * sizeof(pthread_t));
-    session_thread_arg_t *session_args = malloc(max_games * sizeof(session_thread_arg_t));
-
-    for (int i = 0; i < max_games; i++) {
-        session_args[i].session = &sessions[i];
-        session_args[i].level_dir = level_dir;
-        pthread_create(&session_tid[i], NULL, session_thread, (void*)&session_args[i]);
+    // event loops: one worker per core, never more than the number of sessions
+    long n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_workers < 1) n_workers = 1;
+    if (n_workers > max_games) n_workers = max_games;
+    // PACMAN_HEARTBEAT_MS: longest gap between two frames of an idle board
+    const char *heartbeat = getenv("PACMAN_HEARTBEAT_MS");
+    if (heartbeat) engine_set_heartbeat(atoi(heartbeat));
+    // PACMAN_INPUT_QUEUE: 1 keeps one queued turn besides the newest play
+    const char *input_queue = getenv("PACMAN_INPUT_QUEUE");
+    if (input_queue) engine_set_input_queue(atoi(input_queue));
+
+    // PACMAN_PIN_CPUS=1 binds each worker to one core
+    const char *pin = getenv("PACMAN_PIN_CPUS");
+    int pin_cpus = pin && strcmp(pin, "0") != 0;
+    if (workers_start(sessions, max_games, (int)n_workers, pin_cpus) < 0) {
+        perror("workers_start\n");
+        close_debug_file();
+        exit(1);
     }
 
-    // esperar threads terminarem (nunca acontece)
+    pthread_t acceptor_tid;
+    pthread_create(&acceptor_tid, NULL, acceptor_thread, NULL);
+
+    // o manager so termina se o FIFO de registo falhar
     pthread_join(manager_tid, NULL);
 
-    for (int i = 0; i < max_games; i++) {
-        pthread_join(session_tid[i], NULL);
-    }
+    // parar quem usa as sessions antes de as libertar: acceptor, openers
+    // (no maximo CONNECT_TIMEOUT_MS) e por fim os workers
+    queue_close(&queue);
+    workers_close_slots();
+    pthread_join(acceptor_tid, NULL);
+    pthread_mutex_lock(&openers_lock);
+    while (n_openers > 0) pthread_cond_wait(&openers_done, &openers_lock);
+    pthread_mutex_unlock(&openers_lock);
+    workers_stop();
 
     // cleanup
     close(register_fd);
     if (reg_wr_dummy >= 0) close(reg_wr_dummy);
 
-    free(session_tid);
-    free(session_args);
     free(sessions);
 
     close_debug_file();
@@ -1,12 +1,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include "parser.h"
 #include "debug.h"
 #include "board.h"
 #include <fcntl.h>
 
+// Writes row y of the bordered grid from a level line (NULL for a missing row),
+// opening a band of tiles on its first row and sealing it after the last
+static int put_row(board_t* board, int y, const char* line, int len) {
+    if (((y + 1) & TILE_MASK) == 0 && board_open_band(board, y) < 0) return -1;
+
+    for (int x = -1; x <= board->width; x++) {
+        cell_t cell;
+        if (y < 0 || y == board->height || x < 0 || x == board->width) cell = CELL_WALL;
+        else if (!line) cell = 0;
+        else if (x < len && line[x] == 'X') cell = CELL_WALL; // wall
+        else if (x < len && line[x] == '@') cell = CELL_PORTAL; // portal
+        else cell = CELL_DOT | CELL_START_DOT;
+        *board_cell(board, x, y) = cell;
+    }
+
+    if (((y + 2) & TILE_MASK) == 0 || y == board->height) board_seal_band(board, y);
+    return 0;
+}
+
 int read_level(board_t* board, char* filename, char* dirname) {
 
     char fullname[MAX_FILENAME];
@@ -20,7 +40,14 @@ int read_level(board_t* board, char* filename, char* dirname) {
         return -1;
     }
     
-    char command[MAX_COMMAND_LENGTH];
+    line_reader_t reader;
+    reader_init(&reader, fd);
+    char *command = NULL;
+
+    // nothing carries over from the previous level: a missing DIM is an error
+    board->width = 0;
+    board->height = 0;
+    board->n_ghosts = 0;
 
     // Pacman is optional
     board->pacman_file[0] = '\0';
@@ -30,7 +57,8 @@ int read_level(board_t* board, char* filename, char* dirname) {
     *strrchr(board->level_name, '.') = '\0';
 
     int read;
-    while ((read = read_line(fd, command)) > 0) {
+    while ((read = read_line(&reader)) > 0) {
+        command = reader.line;
 
         // comment
         if (command[0] == '#' || command[0] == '\0') continue;
@@ -81,55 +109,43 @@ int read_level(board_t* board, char* filename, char* dirname) {
         }
     }
 
-    if (!board->width || !board->height) {
-        debug("Missing dimensions in level file\n");
+    if (board->width <= 0 || board->height <= 0 || board->width > MAX_BOARD_SIDE ||
+        board->height > MAX_BOARD_SIDE || (long long)board->width * board->height > INT_MAX) {
+        debug("Missing or invalid dimensions in level file\n");
+        reader_free(&reader);
         close(fd);
         return -1;
     }
     
-    // the end of the file contains the grid
-    board->board = calloc(board->width * board->height, sizeof(board_pos_t));
+    // the end of the file contains the grid, stored band by band of tiles
     board->pacmans = calloc(board->n_pacmans, sizeof(pacman_t));
     board->ghosts = calloc(board->n_ghosts, sizeof(ghost_t));
+    if (board_alloc_tiles(board) < 0) {
+        reader_free(&reader);
+        close(fd);
+        return -1;
+    }
 
-    int row = 0;
+    // rows -1 and height are the wall border; rows missing from the file stay empty.
     // command here still holds the previous line
-    while (read > 0) {
-        if (command[0]== '#' || command[0] == '\0') continue;
-        if (row >= board->height) break;
-
-        debug("Line: %s\n", command);
-
-        for (int col = 0; col < board -> width; col++){
-            int idx = row * board->width + col;
-            char content = command[col];
-
-            switch (content) {
-                case 'X': // wall
-                    board->board[idx].content = 'W';
-                    break;
-                case '@': // portal
-                    board->board[idx].content = ' ';
-                    board->board[idx].has_portal = 1;
-                    break;
-                default:
-                    board->board[idx].content = ' ';
-                    board->board[idx].has_dot = 1;
-                    break;
-            }
+    for (int row = -1; row <= board->height; row++) {
+        int grid = row >= 0 && row < board->height && read > 0;
+        if (grid && row > 0) {
+            read = read_line(&reader);
+            grid = read > 0;
+        }
+        if (put_row(board, row, grid ? reader.line : NULL, grid ? read : 0) < 0) {
+            read = -1;
+            break;
         }
-
-        row++;
-        read = read_line(fd, command);
     }
 
+    reader_free(&reader);
+    close(fd);
     if (read == -1) {
       debug("Failed parsing line");
-      close(fd);
       return read;
     }
-
-    close(fd);
     return 0;
 }
 
@@ -146,11 +162,11 @@ int read_pacman(board_t* board, int points) {
         // default position -> find first non occupied cell
         for (int i = 0; i < board->height; i++) {
             for (int j = 0; j < board->width; j++) {
-                int idx = i * board->width + j;
-                if (board->board[idx].content == ' ') {
+                cell_t *cell = board_cell(board, j, i);
+                if (!(*cell & CELL_CONTENT)) {
                     pacman->pos_x = j;
                     pacman->pos_y = i;
-                    board->board[idx].content = 'P';
+                    cell_set_content(cell, CELL_PACMAN);
                     goto pacman_inserted;
                 }
             }
@@ -161,10 +177,12 @@ int read_pacman(board_t* board, int points) {
     }
 
     int fd = open(board->pacman_file, O_RDONLY);
+    line_reader_t reader;
+    reader_init(&reader, fd);
 
     int read;
-    char command[MAX_COMMAND_LENGTH];
-    while ((read = read_line(fd, command)) > 0) {
+    while ((read = read_line(&reader)) > 0) {
+        char *command = reader.line;
         // comment
         if (command[0] == '#' || command[0] == '\0') continue;
 
@@ -185,8 +203,8 @@ int read_pacman(board_t* board, int points) {
             if (arg1 && arg2) {
                 pacman->pos_x = atoi(arg1);
                 pacman->pos_y = atoi(arg2);
-                int idx = pacman->pos_y * board->width + pacman->pos_x;
-                board->board[idx].content = 'P';
+                cell_t *cell = board_cell_mut(board, pacman->pos_x, pacman->pos_y);
+                if (cell) cell_set_content(cell, CELL_PACMAN);
                 debug("Pacman Pos = %d x %d\n", pacman->pos_x, pacman->pos_y);
             }
         }
@@ -197,6 +215,7 @@ int read_pacman(board_t* board, int points) {
     pacman->n_moves = 0;
     pacman->current_move = 0;
 
+    reader_free(&reader);
     close(fd);
     return 0;
 }
@@ -206,10 +225,13 @@ int read_ghosts(board_t* board) {
     for (int i = 0; i < board->n_ghosts; i++) {
         int fd = open(board->ghosts_files[i], O_RDONLY);
         ghost_t* ghost = &board->ghosts[i];
+        line_reader_t reader;
+        reader_init(&reader, fd);
 
         int read;
-        char command[MAX_COMMAND_LENGTH];
-        while ((read = read_line(fd, command)) > 0) {
+        char *command = NULL;
+        while ((read = read_line(&reader)) > 0) {
+            command = reader.line;
             // comment
             if (command[0] == '#' || command[0] == '\0') continue;
 
@@ -230,8 +252,8 @@ int read_ghosts(board_t* board) {
                 if (arg1 && arg2) {
                     ghost->pos_x = atoi(arg1);
                     ghost->pos_y = atoi(arg2);
-                    int idx = ghost->pos_y * board->width + ghost->pos_x;
-                    board->board[idx].content = 'M';
+                    cell_t *cell = board_cell_mut(board, ghost->pos_x, ghost->pos_y);
+                    if (cell) cell_set_content(cell, CELL_GHOST);
                     debug("Ghost Pos = %d x %d\n", ghost->pos_x, ghost->pos_y);
                 }
             }
@@ -266,35 +288,66 @@ int read_ghosts(board_t* board) {
                     move += 1;
                 }
             }
-            read = read_line(fd, command);
+            read = read_line(&reader);
+            command = reader.line;
         }
         ghost->n_moves = move;
 
+        reader_free(&reader);
+        close(fd);
         if (read == -1) {
             debug("Failed reading line\n");
-            close(fd);
             return -1;
         }
-        close(fd);
     }
 
     return 0;
 }
 
-int read_line(int fd, char *buf) {
-    int i = 0;
-    char c;
-    ssize_t n;
+void reader_init(line_reader_t *r, int fd) {
+    r->fd = fd;
+    r->pos = r->len = 0;
+    r->line = NULL;
+    r->cap = 0;
+}
+
+void reader_free(line_reader_t *r) {
+    free(r->line);
+    r->line = NULL;
+    r->cap = 0;
+}
+
+int read_line(line_reader_t *r) {
+    size_t i = 0;
+    ssize_t n = 1;
 
-    while ((n = read(fd, &c, 1)) == 1) {
+    for (;;) {
+        if (r->pos == r->len) {
+            n = read(r->fd, r->buf, sizeof(r->buf));
+            if (n <= 0) break;
+            r->pos = 0;
+            r->len = (size_t)n;
+        }
+        char c = r->buf[r->pos++];
         if (c == '\r') continue;
         if (c == '\n') break;
-        buf[i++] = c;
-        if (i == MAX_COMMAND_LENGTH - 1) break;
+        if (i + 1 >= r->cap || !r->line) {
+            size_t cap = r->cap ? r->cap * 2 : 256;
+            char *line = realloc(r->line, cap);
+            if (!line) return -1;
+            r->line = line;
+            r->cap = cap;
+        }
+        r->line[i++] = c;
+        if (i >= INT_MAX) return -1;
     }
 
-    buf[i] = '\0';
+    if (!r->line) {
+        r->line = malloc(r->cap = 256);
+        if (!r->line) return -1;
+    }
+    r->line[i] = '\0';
     if (n == -1) return -1;
     if (n == 0 && i == 0) return 0;
-    return i;                         
+    return (int)i;
 }
@@ -0,0 +1,163 @@
+#include "wheel.h"
+
+#include <time.h>
+#include <stddef.h>
+
+unsigned long long wheel_clock_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000ULL + (unsigned long long)ts.tv_nsec / 1000000ULL;
+}
+
+static void list_init(wheel_timer_t *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static void list_append(wheel_timer_t *head, wheel_timer_t *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static void list_unlink(wheel_timer_t *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = NULL;
+    t->prev = NULL;
+}
+
+static wheel_timer_t* list_pop(wheel_timer_t *head) {
+    if (head->next == head) return NULL;
+    wheel_timer_t *t = head->next;
+    list_unlink(t);
+    return t;
+}
+
+void wheel_init(timing_wheel_t *wheel, unsigned long long now) {
+    pthread_mutex_init(&wheel->lock, NULL);
+    wheel->now = now;
+    wheel->count = 0;
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        for (int s = 0; s < WHEEL_SLOTS; s++) {
+            list_init(&wheel->slots[l][s]);
+        }
+    }
+}
+
+// Picks the level whose span covers the distance to expiry, indexed by the expiry digit of that level.
+// Timers already due go to the slot of tick first (the next tick, or the current one while cascading).
+static void place(timing_wheel_t *wheel, wheel_timer_t *t, unsigned long long first) {
+    unsigned long long expires = t->expires;
+    if (expires < first) expires = first;
+
+    unsigned long long delta = expires - wheel->now;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    // beyond the top level: park it in the last slot, it is placed again when cascaded
+    if (delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS))) {
+        expires = wheel->now + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    }
+
+    int slot = (int)((expires >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    list_append(&wheel->slots[level][slot], t);
+}
+
+void wheel_add(timing_wheel_t *wheel, wheel_timer_t *t, unsigned long long expires) {
+    pthread_mutex_lock(&wheel->lock);
+    if (t->next) list_unlink(t);
+    else wheel->count++;
+
+    t->expires = expires;
+    place(wheel, t, wheel->now + 1);
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+int wheel_cancel(timing_wheel_t *wheel, wheel_timer_t *t) {
+    pthread_mutex_lock(&wheel->lock);
+    int pending = t->next != NULL;
+    if (pending) {
+        list_unlink(t);
+        wheel->count--;
+    }
+    pthread_mutex_unlock(&wheel->lock);
+    return pending;
+}
+
+// Spreads a slot of an upper level over the levels below it
+static void cascade(timing_wheel_t *wheel, int level, int slot) {
+    wheel_timer_t pending;
+    list_init(&pending);
+
+    wheel_timer_t *head = &wheel->slots[level][slot];
+    wheel_timer_t *t;
+    while ((t = list_pop(head)) != NULL) list_append(&pending, t);
+    while ((t = list_pop(&pending)) != NULL) place(wheel, t, wheel->now);
+}
+
+void wheel_advance(timing_wheel_t *wheel, unsigned long long now, wheel_fire_fn fire, void *arg) {
+    pthread_mutex_lock(&wheel->lock);
+    if (wheel->count == 0) {
+        if (now > wheel->now) wheel->now = now;
+        pthread_mutex_unlock(&wheel->lock);
+        return;
+    }
+
+    while (wheel->now < now) {
+        wheel->now++;
+        unsigned long long tick = wheel->now;
+
+        // every 64^l ticks the next slot of level l is due to be spread
+        if ((tick & WHEEL_MASK) == 0) {
+            for (int l = 1; l < WHEEL_LEVELS; l++) {
+                int slot = (int)((tick >> (WHEEL_BITS * l)) & WHEEL_MASK);
+                cascade(wheel, l, slot);
+                if (slot != 0) break;
+            }
+        }
+
+        wheel_timer_t *head = &wheel->slots[0][tick & WHEEL_MASK];
+        wheel_timer_t *t;
+        while ((t = list_pop(head)) != NULL) {
+            wheel->count--;
+            t->fired_at = now;
+            fire(t, arg);
+        }
+
+        if (wheel->count == 0) {
+            wheel->now = now;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+unsigned long long wheel_next(timing_wheel_t *wheel) {
+    pthread_mutex_lock(&wheel->lock);
+    if (wheel->count == 0) {
+        pthread_mutex_unlock(&wheel->lock);
+        return 0;
+    }
+
+    unsigned long long best = 0;
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        int shift = WHEEL_BITS * l;
+        unsigned long long cur = wheel->now >> shift;
+
+        for (int k = 1; k <= WHEEL_SLOTS; k++) {
+            wheel_timer_t *head = &wheel->slots[l][(cur + (unsigned long long)k) & WHEEL_MASK];
+            if (head->next == head) continue;
+
+            // level 0 slots expire at that tick, upper slots are cascaded at their boundary
+            unsigned long long when = (cur + (unsigned long long)k) << shift;
+            if (!best || when < best) best = when;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&wheel->lock);
+    return best;
+}
@@ -0,0 +1,543 @@
+#define _GNU_SOURCE     // pthread_setaffinity_np
+#include "worker.h"
+#include "engine.h"
+#include "debug.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#define MAX_EVENTS 64
+#define STEAL_MIN 2             // run queue length at which idle peers may steal
+#define MIGRATE_AFTER_STEALS 8  // consecutive stolen steps before the session moves
+
+static worker_t *workers;
+static int n_workers;
+
+// free session slots, linked through sess->next
+static session_t *free_slots;
+static pthread_mutex_t free_lock = PTHREAD_MUTEX_INITIALIZER;
+static sem_t free_count;
+static atomic_int closing_slots; // workers_close_slots was called
+static atomic_int stopping;      // workers_stop was called
+
+static void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Points timer_fd at the absolute CLOCK_MONOTONIC deadline of the next wheel work
+// (one kernel timer per worker, no drift from computing relative delays)
+static void arm_wheel(worker_t *w) {
+    unsigned long long next = wheel_next(&w->wheel);
+    if (next == w->armed) return;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next) {
+        its.it_value.tv_sec = (time_t)(next / 1000);
+        its.it_value.tv_nsec = (long)(next % 1000) * 1000000L;
+    }
+    timerfd_settime(w->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    w->armed = next;
+}
+
+static void wake(worker_t *w) {
+    uint64_t one = 1;
+    if (write(w->wake_fd, &one, sizeof(one)) < 0) {
+        debug("Failed to wake worker %d\n", w->id);
+    }
+}
+
+// Only ask for EPOLLOUT while there are frames waiting for the client
+static void watch_output(session_t *sess) {
+    int pending = sess->out_off < sess->out_len;
+    if (pending == sess->out_watched) return;
+
+    struct epoll_event ev;
+    ev.events = EPOLLET | (pending ? EPOLLOUT : 0);
+    ev.data.ptr = &sess->notif_ev;
+    epoll_ctl(sess->worker->epfd, EPOLL_CTL_MOD, sess->notif_fd, &ev);
+    sess->out_watched = pending;
+}
+
+// Registers both FIFOs on w (edge triggered: a pipe that is already ready reports once on ADD)
+static void watch_session(worker_t *w, session_t *sess) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &sess->req_ev;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, sess->req_fd, &ev);
+
+    ev.events = EPOLLET | (sess->out_watched ? EPOLLOUT : 0);
+    ev.data.ptr = &sess->notif_ev;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, sess->notif_fd, &ev);
+}
+
+static void detach_session(session_t *sess) {
+    worker_t *w = sess->worker;
+
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, sess->req_fd, NULL);
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, sess->notif_fd, NULL);
+
+    // cleanup do cliente mas a session continua disponível
+    close(sess->req_fd);
+    close(sess->notif_fd);
+
+    pthread_mutex_lock(&sess->lock);
+    sess->req_fd = -1;
+    sess->notif_fd = -1;
+    pthread_mutex_unlock(&sess->lock);
+
+    sess->in_len = 0;
+    sess->req_eof = 0;
+    sess->n_plays = 0;
+    sess->quit_req = 0;
+    sess->script_head = 0;
+    sess->script_len = 0;
+    sess->out_len = 0;
+    sess->out_off = 0;
+    sess->out_watched = 0;
+    sess->closing = 0;
+    sess->steals = 0;
+    sess->worker = NULL;
+    sess->wheel = NULL;
+    engine_publish(sess);
+
+    pthread_mutex_lock(&w->lock);
+    w->n_sessions--;
+    pthread_mutex_unlock(&w->lock);
+
+    // a run queue entry still pending holds the slot (its ready flag and link)
+    // until run_session drops it: only then can the next game queue it
+    if (atomic_load(&sess->ready)) {
+        sess->release_pending = 1;
+        debug("Session ended, slot freed once its run queue entry is dropped...\n");
+        return;
+    }
+    debug("Session ended, slot free for the next connection...\n");
+    workers_release_slot(sess);
+}
+
+// The game is over (its timers are gone): close once the last frames are out
+static void finish_session(session_t *sess) {
+    sess->closing = 1;
+
+    if (engine_flush(sess) == 1) {
+        watch_output(sess);
+        return;
+    }
+    detach_session(sess);
+}
+
+static void end_level(session_t *sess, int result) {
+    if (engine_end_level(sess, result)) {
+        watch_output(sess);
+    } else {
+        finish_session(sess);
+    }
+}
+
+// Caller holds sess->exec_lock
+static void start_session(worker_t *w, session_t *sess) {
+    sess->worker = w;
+    sess->wheel = &w->wheel;
+    sess->req_ev.kind = IO_REQUEST;
+    sess->req_ev.sess = sess;
+    sess->notif_ev.kind = IO_NOTIF;
+    sess->notif_ev.sess = sess;
+
+    set_nonblocking(sess->req_fd);
+    set_nonblocking(sess->notif_fd);
+    watch_session(w, sess);
+
+    // corre o jogo
+    debug("[worker %d] Starting session game...\n", w->id);
+    if (engine_begin_game(sess)) {
+        watch_output(sess);
+    } else {
+        finish_session(sess);
+    }
+    engine_publish(sess);
+}
+
+static void on_tick(session_t *sess) {
+    int result = engine_step(sess);
+    if (result != CONTINUE_PLAY) {
+        end_level(sess, result);
+    } else {
+        watch_output(sess);
+    }
+    engine_publish(sess);
+}
+
+static void on_output(session_t *sess, uint32_t events) {
+    int r = (events & EPOLLERR) ? -1 : engine_flush(sess);
+
+    if (sess->closing) {
+        if (r != 1) detach_session(sess);
+        return;
+    }
+
+    // the pipe drained: send what changed while it was full
+    if (r == 0) r = engine_send_changes(sess, 0);
+
+    if (r < 0) {
+        // client closed its notification pipe
+        pthread_mutex_lock(&sess->lock);
+        sess->disconnected = 1;
+        pthread_mutex_unlock(&sess->lock);
+        end_level(sess, QUIT_GAME);
+        engine_publish(sess);
+        return;
+    }
+    watch_output(sess);
+}
+
+// Moves a session (fds, pending timers, load) to the worker that keeps running its steps.
+// Caller holds sess->exec_lock, so no other worker touches it meanwhile.
+static void migrate_session(session_t *sess, worker_t *to) {
+    worker_t *from = sess->worker;
+
+    epoll_ctl(from->epfd, EPOLL_CTL_DEL, sess->req_fd, NULL);
+    epoll_ctl(from->epfd, EPOLL_CTL_DEL, sess->notif_fd, NULL);
+    engine_move_timers(sess, &to->wheel);
+    sess->worker = to;
+    sess->steals = 0;
+    watch_session(to, sess);
+
+    pthread_mutex_lock(&from->lock);
+    from->n_sessions--;
+    pthread_mutex_unlock(&from->lock);
+    pthread_mutex_lock(&to->lock);
+    to->n_sessions++;
+    pthread_mutex_unlock(&to->lock);
+
+    debug("[worker %d] Client %d migrated from worker %d\n", to->id, sess->client_id, from->id);
+}
+
+// Queues a session on w's run queue, once
+static void make_ready(worker_t *w, session_t *sess) {
+    if (atomic_exchange(&sess->ready, 1)) return;
+
+    sess->ready_next = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->run_tail) w->run_tail->ready_next = sess;
+    else w->run_head = sess;
+    w->run_tail = sess;
+    atomic_fetch_add(&w->run_len, 1);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Wheel callback: flags the mover and queues its session once, in expiry order
+static void on_timer_fired(wheel_timer_t *t, void *arg) {
+    make_ready((worker_t*) arg, engine_timer_fired(t));
+}
+
+// Takes up to max sessions off the head of w's run queue
+static session_t* take_ready(worker_t *w, int max) {
+    pthread_mutex_lock(&w->lock);
+    session_t *list = w->run_head, *last = NULL;
+    int taken = 0;
+    for (session_t *s = w->run_head; s && taken < max; s = s->ready_next) {
+        last = s;
+        taken++;
+    }
+    if (last) {
+        w->run_head = last->ready_next;
+        if (!w->run_head) w->run_tail = NULL;
+        last->ready_next = NULL;
+        atomic_fetch_sub(&w->run_len, taken);
+    } else {
+        list = NULL;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return list;
+}
+
+// One step of a due session on worker w, whether w owns it or stole it
+static void run_session(worker_t *w, session_t *sess) {
+    // ready is cleared under exec_lock, so detach_session sees whether an entry is pending
+    pthread_mutex_lock(&sess->exec_lock);
+    atomic_store(&sess->ready, 0);
+    if (sess->release_pending) {
+        sess->release_pending = 0;
+        pthread_mutex_unlock(&sess->exec_lock);
+        debug("Session slot free for the next connection...\n");
+        workers_release_slot(sess);
+        return;
+    }
+
+    worker_t *home = sess->worker;
+    // skip queue entries of games that ended meanwhile
+    if (home && sess->level_dir) {
+        on_tick(sess);
+
+        if (home == w) {
+            sess->steals = 0;
+        } else if (sess->worker == home && sess->level_dir &&
+                   ++sess->steals >= MIGRATE_AFTER_STEALS) {
+            migrate_session(sess, w);
+        }
+    }
+    pthread_mutex_unlock(&sess->exec_lock);
+}
+
+static void run_queue(worker_t *w) {
+    session_t *sess;
+    while ((sess = take_ready(w, 1)) != NULL) run_session(w, sess);
+}
+
+// Hands surplus ready sessions to a peer that is sleeping in epoll_wait
+static void offer_work(worker_t *w) {
+    if (atomic_load(&w->run_len) < STEAL_MIN) return;
+
+    for (int k = 1; k < n_workers; k++) {
+        worker_t *peer = &workers[(w->id + k) % n_workers];
+        if (atomic_load(&peer->idle)) {
+            wake(peer);
+            return;
+        }
+    }
+}
+
+// Idle worker: run half of the ready sessions of every backed-up peer
+static void steal_work(worker_t *w) {
+    for (int k = 1; k < n_workers; k++) {
+        worker_t *victim = &workers[(w->id + k) % n_workers];
+        int len = atomic_load(&victim->run_len);
+        if (len < STEAL_MIN) continue;
+
+        session_t *batch = take_ready(victim, len / 2);
+        if (!batch) continue;
+        while (batch) {
+            session_t *sess = batch;
+            batch = sess->ready_next;
+            run_session(w, sess);
+        }
+        // the stolen steps rescheduled timers on the victim's wheel: let it re-arm
+        wake(victim);
+    }
+}
+
+static void pin_worker(worker_t *w) {
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus < 1) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->id % n_cpus, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        debug("[worker %d] Failed to pin to CPU %ld\n", w->id, w->id % n_cpus);
+    }
+}
+
+static void adopt_inbox(worker_t *w) {
+    uint64_t count;
+    if (read(w->wake_fd, &count, sizeof(count)) < 0) return;
+
+    pthread_mutex_lock(&w->lock);
+    session_t *list = w->inbox;
+    w->inbox = NULL;
+    pthread_mutex_unlock(&w->lock);
+
+    while (list) {
+        session_t *sess = list;
+        list = list->next;
+        sess->next = NULL;
+
+        pthread_mutex_lock(&sess->exec_lock);
+        start_session(w, sess);
+        pthread_mutex_unlock(&sess->exec_lock);
+    }
+}
+
+static void* worker_thread(void *arg) {
+    worker_t *w = (worker_t*) arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (w->pinned) pin_worker(w);
+
+    while (1) {
+        atomic_store(&w->idle, 1);
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, -1);
+        atomic_store(&w->idle, 0);
+        if (atomic_load(&stopping)) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            debug("[worker %d] epoll_wait failed\n", w->id);
+            break;
+        }
+
+        // timers first: queue every due session, let an idle peer share a long queue
+        wheel_advance(&w->wheel, wheel_clock_ms(), on_timer_fired, w);
+        offer_work(w);
+        run_queue(w);
+
+        for (int i = 0; i < n; i++) {
+            io_event_t *io = (io_event_t*) events[i].data.ptr;
+            session_t *sess = io->sess;
+
+            if (sess) {
+                pthread_mutex_lock(&sess->exec_lock);
+                // stale event for a session detached or migrated since epoll_wait
+                if (sess->worker == w) {
+                    // a quit or disconnect is stepped right away, not at the next tick
+                    if (io->kind == IO_REQUEST) {
+                        if (engine_read_requests(sess) && sess->level_dir) make_ready(w, sess);
+                    } else {
+                        on_output(sess, events[i].events);
+                    }
+                }
+                pthread_mutex_unlock(&sess->exec_lock);
+                continue;
+            }
+
+            switch (io->kind) {
+                case IO_WAKE:
+                    adopt_inbox(w);
+                    break;
+                case IO_TIMER: {
+                    uint64_t expirations;
+                    if (read(w->timer_fd, &expirations, sizeof(expirations)) < 0) break;
+                    w->armed = 0;
+                    break;
+                }
+            }
+        }
+        // sessions queued by their requests (a quit, a closed pipe) step now, not after
+        // the next wake-up: this also drops entries of games detached meanwhile
+        run_queue(w);
+
+        steal_work(w);
+        arm_wheel(w);
+    }
+    return NULL;
+}
+
+int workers_start(session_t *sessions, int max_games, int count, int pin_cpus) {
+    n_workers = count;
+    workers = calloc((size_t)n_workers, sizeof(worker_t));
+    if (!workers) return -1;
+
+    free_slots = NULL;
+    for (int i = max_games - 1; i >= 0; i--) {
+        sessions[i].next = free_slots;
+        free_slots = &sessions[i];
+    }
+    sem_init(&free_count, 0, (unsigned)max_games);
+
+    for (int i = 0; i < n_workers; i++) {
+        worker_t *w = &workers[i];
+        w->id = i;
+        w->pinned = pin_cpus;
+        pthread_mutex_init(&w->lock, NULL);
+
+        w->epfd = epoll_create1(EPOLL_CLOEXEC);
+        w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        w->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (w->epfd < 0 || w->wake_fd < 0 || w->timer_fd < 0) {
+            debug("Failed to create worker %d event loop\n", i);
+            return -1;
+        }
+
+        w->wake_ev.kind = IO_WAKE;
+        w->wake_ev.sess = NULL;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &w->wake_ev;
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wake_fd, &ev);
+
+        w->timer_ev.kind = IO_TIMER;
+        w->timer_ev.sess = NULL;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &w->timer_ev;
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->timer_fd, &ev);
+
+        wheel_init(&w->wheel, wheel_clock_ms());
+        w->armed = 0;
+
+        pthread_create(&w->tid, NULL, worker_thread, (void*) w);
+    }
+
+    debug("Started %d workers for %d sessions%s\n", n_workers, max_games, pin_cpus ? " (pinned)" : "");
+    return 0;
+}
+
+session_t* workers_acquire_slot(void) {
+    while (sem_wait(&free_count) < 0 && errno == EINTR);
+    if (atomic_load(&closing_slots)) {
+        sem_post(&free_count); // wake the next waiter too
+        return NULL;
+    }
+
+    pthread_mutex_lock(&free_lock);
+    session_t *sess = free_slots;
+    free_slots = sess->next;
+    sess->next = NULL;
+    pthread_mutex_unlock(&free_lock);
+
+    return sess;
+}
+
+void workers_release_slot(session_t *sess) {
+    pthread_mutex_lock(&free_lock);
+    sess->next = free_slots;
+    free_slots = sess;
+    pthread_mutex_unlock(&free_lock);
+
+    sem_post(&free_count);
+}
+
+void workers_attach(session_t *sess) {
+    worker_t *target = NULL;
+    int best = 0;
+
+    for (int i = 0; i < n_workers; i++) {
+        pthread_mutex_lock(&workers[i].lock);
+        int load = workers[i].n_sessions;
+        pthread_mutex_unlock(&workers[i].lock);
+        if (!target || load < best) {
+            target = &workers[i];
+            best = load;
+        }
+    }
+
+    pthread_mutex_lock(&target->lock);
+    sess->next = target->inbox;
+    target->inbox = sess;
+    target->n_sessions++;
+    pthread_mutex_unlock(&target->lock);
+
+    wake(target);
+}
+
+void workers_close_slots(void) {
+    atomic_store(&closing_slots, 1);
+    sem_post(&free_count);
+}
+
+void workers_stop(void) {
+    atomic_store(&stopping, 1);
+    for (int i = 0; i < n_workers; i++) {
+        wake(&workers[i]);
+        pthread_join(workers[i].tid, NULL);
+    }
+    for (int i = 0; i < n_workers; i++) {
+        close(workers[i].epfd);
+        close(workers[i].wake_fd);
+        close(workers[i].timer_fd);
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    free(workers);
+    workers = NULL;
+    n_workers = 0;
+    debug("Workers stopped\n");
+}